@@ -3,6 +3,7 @@
 //
 #pragma once
 #include "core.h"
+#include "texture_cache.h"
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_render.h>
 #include <atomic>
@@ -18,26 +19,30 @@ namespace anisette::components {
         explicit Background(SDL_Renderer *renderer) : renderer(renderer) {
             texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, core::video::render_rect.w, core::video::render_rect.h);
             SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-            new_texture = nullptr;
             start_time = 0;
         }
 
         std::atomic_bool enable_parallax = false;
 
-        void load(const std::string &path, const uint64_t &now) {
-            if (new_texture) SDL_DestroyTexture(new_texture);
+        void load(const std::string &path, const uint64_t &now, const uint64_t content_id = 0) {
+            // the same image, possibly under another path: keep the current texture and its fade
+            if (!path.empty() && (content_id != 0 ? content_id == current_img_id : path == current_img_path)) return;
+            new_image.reset();
+            current_img_path = path;
+            current_img_id = content_id;
             if (path.empty()) {
-                new_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, core::video::render_rect.w, core::video::render_rect.h);
-            };
-            if (path != current_img_path) {
-                current_img_path = path;
-                new_texture = IMG_LoadTexture(renderer, path.c_str());
+                const int width = core::video::render_rect.w, height = core::video::render_rect.h;
+                SDL_Texture *blank = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                                       width, height);
+                if (blank) new_image = std::make_shared<const core::video::CachedTexture>(blank, width, height);
+            } else {
+                // shared with the thumbnail of the same image, and kept cached for when it comes back
+                new_image = core::video::load_texture(path, content_id);
             }
-            if (new_texture) {
-                SDL_SetTextureBlendMode(new_texture, SDL_BLENDMODE_BLEND);
-                SDL_SetTextureAlphaMod(new_texture, 0);
-                int width, height;
-                SDL_QueryTexture(new_texture, nullptr, nullptr, &width, &height);
+            if (new_image) {
+                SDL_SetTextureBlendMode(new_image->texture, SDL_BLENDMODE_BLEND);
+                SDL_SetTextureAlphaMod(new_image->texture, 0);
+                const int width = new_image->w, height = new_image->h;
                 const auto screen_ratio = static_cast<double>(core::video::render_rect.w) / core::video::render_rect.h;
                 const auto img_ratio = static_cast<double>(width) / height;
                 // calculate background rect
@@ -60,19 +65,16 @@ namespace anisette::components {
 
         void draw(const uint64_t& now) {
             if (!texture) return;
-            if (new_texture) {
+            if (new_image) {
                 // calculate alpha
                 const uint64_t delta = now > start_time ? now - start_time : 0;
                 auto alpha = 255 * delta / (core::system_freq * BACKGROUND_SWAP_DURATION_MS / 1000);
                 if (alpha > 255) alpha = 255;
-                SDL_SetTextureAlphaMod(new_texture, alpha);
+                SDL_SetTextureAlphaMod(new_image->texture, alpha);
                 // render to buffer
                 SDL_SetRenderTarget(renderer, texture);
-                SDL_RenderCopy(renderer, new_texture, &bg_rect, nullptr);
-                if (alpha == 255) {
-                    SDL_DestroyTexture(new_texture);
-                    new_texture = nullptr;
-                }
+                SDL_RenderCopy(renderer, new_image->texture, &bg_rect, nullptr);
+                if (alpha == 255) new_image.reset();
             }
             SDL_Rect draw_rect = {0, 0, core::video::render_rect.w, core::video::render_rect.h};
             if (enable_parallax) {
@@ -91,14 +93,14 @@ namespace anisette::components {
 
         ~Background() {
             SDL_DestroyTexture(texture);
-            SDL_DestroyTexture(new_texture);
         }
 
     private:
         SDL_Renderer *renderer;
         SDL_Rect bg_rect {0, 0, 0, 0};
         std::string current_img_path;
-        SDL_Texture *new_texture;
+        uint64_t current_img_id = 0;
+        core::video::TextureHandle new_image;
         SDL_Texture *texture;
         uint64_t start_time;
     };
@@ -3,6 +3,7 @@
 //
 #pragma once
 #include "core.h"
+#include "glyph_atlas.h"
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_render.h>
 
@@ -20,20 +21,13 @@ namespace anisette::components
         };
 
         void render_text(const std::string &text, const int font_size, const SDL_Color &color, int &max_width, int &max_height) const {
-            TTF_SetFontSize(core::video::primary_font, font_size);
-            SDL_Surface *surface = TTF_RenderText_Blended(core::video::primary_font, text.c_str(), color);
-            if (!surface) return;
-            SDL_Texture *text_texture = SDL_CreateTextureFromSurface(renderer, surface);
-            if (!text_texture) {
-                SDL_FreeSurface(surface);
-                return;
-            }
-            const SDL_Rect rect = {5, max_height, surface->w, surface->h};
-            max_width = std::max(max_width, surface->w + 10);
-            max_height += surface->h;
-            SDL_FreeSurface(surface);
-            SDL_RenderCopy(renderer, text_texture, nullptr, &rect);
-            SDL_DestroyTexture(text_texture);
+            const auto atlas = core::video::GlyphAtlas::get(core::video::primary_font, font_size);
+            if (!atlas) return;
+            int w, h;
+            atlas->measure(text, w, h);
+            atlas->draw(text, 5, max_height, color);
+            max_width = std::max(max_width, w + 10);
+            max_height += h;
         }
 
         void draw(const uint64_t &now) {
@@ -65,8 +59,8 @@ namespace anisette::components
                 src_rect.w = 0;
                 src_rect.h = 0;
                 // render the text
-                render_text(fps_text, 16, *selected_color, src_rect.w, src_rect.h);
-                render_text(frame_time_text, 12, *selected_color, src_rect.w, src_rect.h);
+                render_text(fps_text, FRT_OVERLAY_FONT_SIZE_1, *selected_color, src_rect.w, src_rect.h);
+                render_text(frame_time_text, FRT_OVERLAY_FONT_SIZE_2, *selected_color, src_rect.w, src_rect.h);
                 // dst_rect = get_overlay_render_position(
                 //     core::video::RIGHT, core::video::BOTTOM,
                 //     src_rect.w, src_rect.h, 10, 10
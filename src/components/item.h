@@ -3,6 +3,8 @@
 //
 #pragma once
 #include "core.h"
+#include "glyph_atlas.h"
+#include "texture_cache.h"
 #include <string>
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL2_gfxPrimitives.h>
@@ -108,12 +110,8 @@ namespace anisette::components {
 
         void draw(SDL_Renderer *renderer, const SDL_Rect area, const bool hovered) override {
             if (!init_finished) {
-                // load text texture
-                icon = IMG_LoadTexture(renderer, icon_path.c_str());
-                if (icon) {
-                    SDL_SetTextureBlendMode(icon, SDL_BLENDMODE_BLEND);
-                    SDL_QueryTexture(icon, nullptr, nullptr, &icon_w, &icon_h);
-                }
+                // load icon texture, shared with every button using the same icon
+                icon = core::video::load_texture(icon_path);
                 init_finished = true;
             }
 
@@ -143,6 +141,7 @@ namespace anisette::components {
                 roundedBoxRGBA(renderer, 0, 0,  area.w, area.h, ROUNDED_RECTANGLE_RADIUS, r, g, b, a);
                 // draw icon
                 if (!icon) return;
+                const int icon_w = icon->w, icon_h = icon->h;
                 const double area_ratio = static_cast<double>(area.w) / area.h;
                 const double icon_ratio = static_cast<double>(icon_w) / icon_h;
                 SDL_Rect icon_rect{0, 0, 0, 0};
@@ -155,7 +154,7 @@ namespace anisette::components {
                     icon_rect.w = icon_w * area.h / icon_h;
                     icon_rect.x = (area.w - icon_rect.w) / 2;
                 }
-                SDL_RenderCopy(renderer, icon, nullptr, &icon_rect);
+                SDL_RenderCopy(renderer, icon->texture, nullptr, &icon_rect);
             }
             SDL_SetRenderTarget(renderer, nullptr);
             SDL_SetTextureAlphaMod(texture, alpha);
@@ -165,15 +164,13 @@ namespace anisette::components {
 
         ~IconButton() override {
             SDL_DestroyTexture(texture);
-            SDL_DestroyTexture(icon);
         }
 
         SDL_Color background;
         SDL_Color hover_background;
     private:
         const std::string icon_path;
-        int icon_w = 0, icon_h = 0;
-        SDL_Texture *icon = nullptr;
+        core::video::TextureHandle icon;
         SDL_Texture *texture = nullptr;
     };
 
@@ -182,28 +179,22 @@ namespace anisette::components {
         Text(const std::string &text, const int size, const SDL_Color foreground) : text(text), foreground(foreground), font_size(size) {}
 
         void draw(SDL_Renderer *renderer, const SDL_Rect area, const bool hovered) override {
+            // glyphs come from the shared atlas, a new text is only measured
+            if (atlas == nullptr || atlas_font != font) {
+                atlas = core::video::GlyphAtlas::get(font, font_size);
+                atlas_font = font;
+                init_finished = false;
+            }
+            if (!atlas) return;
             if (!init_finished) {
-                SDL_DestroyTexture(texture);
-                TTF_SetFontSize(font, font_size);
-                const auto surface = TTF_RenderText_Blended(font, text.c_str(), foreground);
-                if (!surface) return;
-                texture = SDL_CreateTextureFromSurface(renderer, surface);
-                SDL_FreeSurface(surface);
-                if (!texture) return;
-                SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-                SDL_QueryTexture(texture, nullptr, nullptr, &text_w, &text_h);
+                atlas->measure(text, text_w, text_h);
                 init_finished = true;
             }
-            if (!texture) return;
-            const SDL_Rect src_rect {0, 0, text_w > area.w ? area.w : text_w, text_h > area.h ? area.h : text_h};
-            const SDL_Rect text_rect {area.x + (area.w - src_rect.w) / 2, area.y + (area.h - src_rect.h) / 2, src_rect.w, src_rect.h};
-            SDL_SetTextureAlphaMod(texture, alpha);
+            const int w = text_w > area.w ? area.w : text_w, h = text_h > area.h ? area.h : text_h;
+            const SDL_Color color {foreground.r, foreground.g, foreground.b,
+                                   static_cast<Uint8>(foreground.a * alpha / 255)};
             SDL_SetRenderTarget(renderer, nullptr);
-            SDL_RenderCopy(renderer, texture, &src_rect, &text_rect);
-        }
-
-        ~Text() override {
-            SDL_DestroyTexture(texture);
+            atlas->draw(text, area.x + (area.w - w) / 2, area.y + (area.h - h) / 2, color, w);
         }
 
         void change_text(const std::string &new_text) {
@@ -218,21 +209,25 @@ namespace anisette::components {
         SDL_Color foreground;
         const int font_size;
         int text_w = 0, text_h = 0;
+        core::video::GlyphAtlas *atlas = nullptr;
+        TTF_Font *atlas_font = nullptr;
     };
 
     class Image final : public Item {
     public:
-        explicit Image(const std::string &path) : path(path) {}
+        /**
+         * @param content_id Content id of the image, shares its texture with other copies of the file when set
+         */
+        explicit Image(const std::string &path, const uint64_t content_id = 0) : path(path), content_id(content_id) {}
 
         void draw(SDL_Renderer *renderer, SDL_Rect area, const bool hovered) override {
             if (!init_finished) {
-                texture = IMG_LoadTexture(renderer, path.c_str());
-                if (!texture) return;
-                SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-                SDL_QueryTexture(texture, nullptr, nullptr, &img_w, &img_h);
+                // the texture belongs to the cache, not to the base item
+                image = core::video::load_texture(path, content_id);
                 init_finished = true;
             }
-            if (!texture) return;
+            if (!image) return;
+            const int img_w = image->w, img_h = image->h;
             const double area_ratio = static_cast<double>(area.w) / area.h;
             const double img_ratio = static_cast<double>(img_w) / img_h;
             if (img_ratio > area_ratio) {
@@ -242,13 +237,14 @@ namespace anisette::components {
                 area.x += (area.w - img_w * area.h / img_h) / 2;
                 area.w = img_w * area.h / img_h;
             }
-            SDL_SetTextureAlphaMod(texture, alpha);
+            SDL_SetTextureAlphaMod(image->texture, alpha);
             SDL_SetRenderTarget(renderer, nullptr);
-            SDL_RenderCopy(renderer, texture, nullptr, &area);
+            SDL_RenderCopy(renderer, image->texture, nullptr, &area);
         }
     private:
         const std::string path;
-        int img_w = 0, img_h = 0;
+        const uint64_t content_id;
+        core::video::TextureHandle image;
     };
 
     class ProgressBar final : public Item {
@@ -4,7 +4,6 @@
 #pragma once
 #include <SDL2/SDL2_gfxPrimitives.h>
 #include <SDL2/SDL_render.h>
-#include <queue>
 #include "core.h"
 #include "common.h"
 #include "container.h"
@@ -24,31 +23,46 @@ namespace anisette::components
     constexpr SDL_Color KEY_TEXT_COLOR  = {255, 255, 255, 255};
 
     class StageChannel final : public Container {
-        struct NoteDisplayData {
-            bool processed = false, failed = false;
-            int start, end;
+        enum NoteState : uint8_t {
+            PROCESSED = 1 << 0,
+            FAILED = 1 << 1,
         };
 
         utils::ScoreCalculator *score_calculator;
+        const int channel;
         int preview_size_ms;
-        int note_list_index = 0;
         unsigned key_press_count = 0;
         bool last_key_holding_state = false;
-        std::vector<data::Note> *note_list;
-        std::deque<NoteDisplayData> loaded_note;
+        // the channel's slice of the chart columns, notes [head, tail) are on screen
+        const int32_t *note_start;
+        uint32_t note_count;
+        uint32_t head = 0, tail = 0;
+        std::vector<uint8_t> note_state;
         Text *key_text = nullptr;
 
         int current_music_pos_ms = -10000;
         bool ev_key_down = false;
+        // performance counter of the frame the key went down in
+        uint64_t key_down_time = 0;
+
+        // a note is displayed and judged from start - offset to start + offset
+        [[nodiscard]] int display_start(const uint32_t note) const {
+            return note_start[note] - score_calculator->base_offset_ms;
+        }
+
+        [[nodiscard]] int display_end(const uint32_t note) const {
+            return note_start[note] + score_calculator->base_offset_ms;
+        }
 
         [[nodiscard]]
-        SDL_Rect get_note_draw_rect(const NoteDisplayData &note, const SDL_Rect note_display_rect) const {
-            if (note.start > current_music_pos_ms + preview_size_ms) return {0, 0, 0, 0};
-            if (note.end < current_music_pos_ms) return {0, 0, 0, 0};
+        SDL_Rect get_note_draw_rect(const uint32_t note, const SDL_Rect note_display_rect) const {
+            const int start = display_start(note), end = display_end(note);
+            if (start > current_music_pos_ms + preview_size_ms) return {0, 0, 0, 0};
+            if (end < current_music_pos_ms) return {0, 0, 0, 0};
             // calculate rect
             SDL_Rect ans = {note_display_rect.x, note_display_rect.y, note_display_rect.w, 0};
-            const int offset_y = (current_music_pos_ms + preview_size_ms - note.end) * note_display_rect.h / preview_size_ms;
-            int size_y = (note.end - note.start) * note_display_rect.h / preview_size_ms;
+            const int offset_y = (current_music_pos_ms + preview_size_ms - end) * note_display_rect.h / preview_size_ms;
+            int size_y = (end - start) * note_display_rect.h / preview_size_ms;
             if (offset_y + size_y > note_display_rect.h) size_y = note_display_rect.h - offset_y;
             ans.y += offset_y;
             ans.h = size_y;
@@ -58,21 +72,24 @@ namespace anisette::components
     public:
         bool finished = false;
 
-        explicit StageChannel(utils::ScoreCalculator *score_calculator, std::vector<data::Note> *note_list, const std::string &init_text)
-            : score_calculator(score_calculator), note_list(note_list) {
+        explicit StageChannel(utils::ScoreCalculator *score_calculator, const data::NoteChart *chart, const int channel,
+                              const std::string &init_text)
+            : score_calculator(score_calculator), channel(channel), note_start(chart->start.data() + chart->channel_begin[channel]),
+              note_count(chart->channel_size(channel)), note_state(note_count) {
             key_text = new Text(init_text, NOTE_DISPLAY_FONT_SIZE, KEY_TEXT_COLOR);
             preview_size_ms = score_calculator->base_offset_ms * NOTE_DISPLAY_SIZE;
         }
 
-        void bind_value(const int current_music_pos_ms, const bool key_holding = false) {
+        void bind_value(const int current_music_pos_ms, const bool key_holding = false, const uint64_t now = 0) {
             this->current_music_pos_ms = current_music_pos_ms;
             ev_key_down = key_holding && !last_key_holding_state;
+            if (ev_key_down) key_down_time = now;
             last_key_holding_state = key_holding;
         }
 
         void draw(SDL_Renderer *renderer, const SDL_Rect draw_rect, const uint8_t alpha) override {
             if (hidden) return;
-            if (loaded_note.empty() && note_list_index >= note_list->size()) finished = true;
+            if (head >= note_count) finished = true;
             // draw border lines
             SDL_SetRenderTarget(renderer, nullptr);
             SDL_SetRenderDrawColor(renderer, 255, 255, 255, alpha);
@@ -85,26 +102,28 @@ namespace anisette::components
             // if key down
             if (ev_key_down) {
                 key_press_count++;
-                for (auto &[processed, failed, start, end] : loaded_note) {
-                    if (start > current_music_pos_ms + score_calculator->base_offset_ms) break;
-                    if (processed) continue;
-                    processed = true;
-                    if (start <= current_music_pos_ms && current_music_pos_ms <= end) {
-                        core::audio::play_hit_sound();
+                key_text->change_text(std::to_string(key_press_count));
+                for (auto note = head; note < tail; note++) {
+                    if (display_start(note) > current_music_pos_ms + score_calculator->base_offset_ms) break;
+                    if (note_state[note] & PROCESSED) continue;
+                    note_state[note] |= PROCESSED;
+                    if (display_start(note) <= current_music_pos_ms && current_music_pos_ms <= display_end(note)) {
+                        core::audio::play_hit_sound(channel, true, key_down_time);
                         score_calculator->submit_success();
                     } else {
-                        failed = true;
+                        core::audio::play_hit_sound(channel, false, key_down_time);
+                        note_state[note] |= FAILED;
                         score_calculator->submit_fail();
                     }
                     break;
                 }
             }
             // draw notes
-            for (const auto &note : loaded_note) {
+            for (auto note = head; note < tail; note++) {
                 const auto rect = get_note_draw_rect(note, note_display_rect);
                 if (rect.w == 0 || rect.h == 0) continue;
                 int r = NOTE_COLOR.r, g = NOTE_COLOR.g, b = NOTE_COLOR.b, a = NOTE_COLOR.a;
-                if (note.failed) {
+                if (note_state[note] & FAILED) {
                     r = NOTE_FAIL_COLOR.r;
                     g = NOTE_FAIL_COLOR.g;
                     b = NOTE_FAIL_COLOR.b;
@@ -123,26 +142,15 @@ namespace anisette::components
                 a = KEY_HOLD_COLOR.a;
             }
             roundedBoxRGBA(renderer, key_display_rect.x, key_display_rect.y, key_display_rect.x + key_display_rect.w, key_display_rect.y + key_display_rect.h, ROUNDED_RECTANGLE_RADIUS, r, g, b, a);
-            if (key_press_count > 0) key_text->change_text(std::to_string(key_press_count));
             key_text->draw(renderer, key_display_rect, false);
             // delete old notes
-            while (!loaded_note.empty()) {
-                auto front = loaded_note.front();
-                if (front.end > current_music_pos_ms) break;
-                if (!front.processed) score_calculator->submit_fail();
-                loaded_note.pop_front();
+            while (head < tail) {
+                if (display_end(head) > current_music_pos_ms) break;
+                if (!(note_state[head] & PROCESSED)) score_calculator->submit_fail();
+                head++;
             }
             // load new notes
-            while (note_list_index < note_list->size()) {
-                auto &note = note_list->at(note_list_index);
-                if (note.start > current_music_pos_ms + preview_size_ms) break;
-                loaded_note.push_back({
-                    false, false,
-                    note.start - score_calculator->base_offset_ms,
-                    note.start + score_calculator->base_offset_ms
-                });
-                note_list_index++;
-            }
+            while (tail < note_count && note_start[tail] <= current_music_pos_ms + preview_size_ms) tail++;
         }
 
         void set_hidden(const bool state) override {
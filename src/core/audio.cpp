@@ -4,9 +4,31 @@
 #include "core.h"
 #include "internal.h"
 #include "config.h"
+#include "hit_sounds.h"
 #include "logging.h"
+#include "music_stream.h"
+#include "pcm_cache.h"
 #include <SDL2/SDL_mixer.h>
 #include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <unordered_set>
+
+// used when the native rate of the device cannot be queried
+#define DEFAULT_SAMPLE_RATE 44100
+// the device plays one buffer while the mixer fills the next one
+#define OUTPUT_BUFFER_COUNT 2
+// the smoothed music clock jumps to the measured position when they are this far apart, e.g. after a seek
+#define CLOCK_SNAP_MS 50.0
+// share of the remaining error corrected on every read, small enough to hide the callback jitter
+#define CLOCK_CORRECTION 0.05
+// decoded previews kept for scrolling back and forth, about 30 clips at 48 kHz
+#define PREVIEW_CACHE_BYTES (16 << 20)
+// covers opening the file on the music thread, playback continues from the file afterwards
+#define PREVIEW_CLIP_MS 3000
+// preview clips extracted after a library scan, about 560 KB per song at 48 kHz
+#define PREVIEW_STORE_DIR "cache/previews"
 
 const auto logger = anisette::logging::get("audio");
 
@@ -14,29 +36,59 @@ namespace anisette::core::audio
 {
     uint32_t MUSIC_FINISHED_EVENT_ID = SDL_RegisterEvents(1);
 
-    static Mix_Music *current_music = nullptr;
+    // music is decoded on its own thread and mixed through the music hook, Mix_Music is not used
+    static MusicStream music_stream(MUSIC_FINISHED_EVENT_ID);
+    static std::atomic_int music_volume_level = MIX_MAX_VOLUME;
+    static PcmCache preview_cache("preview", PREVIEW_CLIP_MS, PREVIEW_STORE_DIR);
+    // library generation the preview store was last filled for
+    static uint32_t preview_store_generation = 0;
+    // whole songs played recently, a retry starts from memory
+    static PcmCache track_cache("track", 0);
+    // hit sounds skip the mixer channels and are mixed in the post-mix callback
+    static HitSoundEngine hit_sounds;
+    static std::atomic_int sound_volume_level = MIX_MAX_VOLUME;
 
     // metadata for current music
     std::string music_display_name;
     std::string music_path;
-    int music_duration_ms = 0;
+    uint64_t music_id = 0;
+
+    // output format of the opened device
+    int sample_rate = DEFAULT_SAMPLE_RATE;
+    static int frame_bytes = 4;
+    // sample frames of the last buffer the device asked for, written by the audio thread
+    static std::atomic_int device_buffer_frames = 0;
+
+    /*
+     * Music clock: the audio thread counts the music frames it has mixed and stamps every buffer with the performance
+     * counter. The pair is published under a sequence lock, odd while being written, so a reader never sees the frame
+     * count of one buffer with the time of another.
+     */
+    static std::atomic_uint32_t clock_sequence = 0;
+    static std::atomic_int64_t clock_frames = 0;
+    static std::atomic_uint64_t clock_counter = 0;
+    static std::atomic_bool clock_running = false;
+    // last play, seek or stop of the music stream that the counted frames already follow
+    static std::atomic_uint32_t clock_serial = 0;
+    // smoothed clock, only touched by the main thread
+    static double smoothed_ms = 0;
+    static uint64_t smoothed_counter = 0;
 
     // frequently used sound
     Mix_Chunk *click_sound = nullptr;
-    Mix_Chunk *hit_sound = nullptr;
 
     void play_click_sound() {
         // allocate channel 1 to click sound
         play_sound(click_sound, 1);
     }
 
-    void play_hit_sound() {
-        // allocate channel 2 to hit sound
-        play_sound(hit_sound, 2);
+    void play_hit_sound(const int channel, const bool hit, const uint64_t time) {
+        hit_sounds.trigger(channel, hit ? HitSoundEngine::HIT : HitSoundEngine::MISS,
+                           time != 0 ? time : SDL_GetPerformanceCounter());
     }
 
     uint8_t music_volume() {
-        return Mix_VolumeMusic(-1);
+        return music_volume_level.load(std::memory_order_relaxed);
     };
 
     uint8_t sound_volume() {
@@ -44,37 +96,147 @@ namespace anisette::core::audio
     }
 
     bool is_paused() {
-        return Mix_PausedMusic();
+        return !music_path.empty() && music_stream.paused();
+    }
+
+    int music_duration_ms() {
+        const int64_t length = music_stream.length();
+        return length > 0 ? static_cast<int>(length * 1000 / sample_rate) : 0;
+    }
+
+    bool music_failed() {
+        return !music_path.empty() && music_stream.open_failed();
+    }
+
+    /**
+     * @brief Position of the music being heard right now, measured from the mixed frames
+     *
+     * Interpolated with the performance counter since the last buffer, but never further than one buffer ahead, so a
+     * stalled audio thread freezes the clock instead of running it past the audio.
+     */
+    static double measured_position_ms(const uint64_t now, bool &running) {
+        // frames are counted when mixed, they are heard one output latency later
+        const int latency_ms = output_latency_ms();
+        int64_t frames;
+        uint64_t counter;
+        uint32_t sequence, serial;
+        do {
+            sequence = clock_sequence.load(std::memory_order_acquire);
+            frames = clock_frames.load(std::memory_order_relaxed);
+            counter = clock_counter.load(std::memory_order_relaxed);
+            running = clock_running.load(std::memory_order_relaxed);
+            serial = clock_serial.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while (sequence & 1 || sequence != clock_sequence.load(std::memory_order_relaxed));
+        // the position is in music time, real time is scaled by the playback rate
+        const double rate = music_stream.rate() / 100.0;
+        // the decoder has not caught up with the last play or seek yet, the music will start from its target
+        if (serial != music_stream.requested_serial()) {
+            running = false;
+            return static_cast<double>(music_stream.requested_frame()) * 1000 / sample_rate - latency_ms * rate;
+        }
+        double position = static_cast<double>(frames) * 1000 / sample_rate;
+        if (running && now > counter) {
+            const double buffer_ms = static_cast<double>(device_buffer_frames.load(std::memory_order_relaxed)) * 1000
+                / sample_rate;
+            const double elapsed_ms = static_cast<double>(now - counter) * 1000 / static_cast<double>(system_freq);
+            position += std::min(elapsed_ms, buffer_ms) * rate;
+        }
+        return position - latency_ms * rate;
     }
 
     int music_position_ms() {
-        if (current_music == nullptr)
-            return 0;
-        const int position = Mix_GetMusicPosition(current_music);
-        if (position == -1) {
-            logger->error("Failed to get music position: {}", SDL_GetError());
-            return 0;
+        if (music_path.empty()) return 0;
+        const uint64_t now = SDL_GetPerformanceCounter();
+        bool running;
+        const double measured = measured_position_ms(now, running);
+        if (!running) {
+            smoothed_ms = measured;
+        } else {
+            // advance with the performance counter and slowly pull towards the measured position, callbacks come in
+            // bursts and would make the raw clock stutter
+            double predicted = smoothed_ms;
+            if (now > smoothed_counter) {
+                predicted += static_cast<double>(now - smoothed_counter) * 1000 / static_cast<double>(system_freq)
+                    * music_stream.rate() / 100.0;
+            }
+            const double error = measured - predicted;
+            // small corrections must not move the notes backwards
+            if (std::abs(error) > CLOCK_SNAP_MS) smoothed_ms = measured;
+            else smoothed_ms = std::max(smoothed_ms, predicted + error * CLOCK_CORRECTION);
         }
-        return position * 1000;
+        smoothed_counter = now;
+        return static_cast<int>(std::lround(smoothed_ms));
+    }
+
+    static int native_sample_rate() {
+#if SDL_VERSION_ATLEAST(2, 24, 0)
+        SDL_AudioSpec spec;
+        if (SDL_GetDefaultAudioInfo(nullptr, &spec, 0) == 0 && spec.freq > 0) return spec.freq;
+#endif
+        return DEFAULT_SAMPLE_RATE;
+    }
+
+    // runs on the audio thread for every buffer, before the channels are mixed
+    static void on_mix_music(void *, Uint8 *stream, const int length) {
+        music_stream.mix(stream, length, music_volume_level.load(std::memory_order_relaxed));
+    }
+
+    // runs on the audio thread after every mixed buffer
+    static void on_post_mix(void *, Uint8 *stream, const int length) {
+        const int frames = length / frame_bytes;
+        device_buffer_frames.store(frames, std::memory_order_relaxed);
+        hit_sounds.mix(reinterpret_cast<int16_t *>(stream), frames, SDL_GetPerformanceCounter(), sample_rate,
+                       sound_volume_level.load(std::memory_order_relaxed));
+        // the music hook of this buffer has run, the stream position is the frame after it
+        const int64_t position = music_stream.position();
+        const bool running = music_stream.running();
+        const uint32_t serial = music_stream.applied_serial();
+        const uint32_t sequence = clock_sequence.load(std::memory_order_relaxed);
+        clock_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        clock_frames.store(position, std::memory_order_relaxed);
+        clock_counter.store(SDL_GetPerformanceCounter(), std::memory_order_relaxed);
+        clock_running.store(running, std::memory_order_relaxed);
+        clock_serial.store(serial, std::memory_order_relaxed);
+        clock_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    int output_latency_ms() {
+        const int frames = device_buffer_frames.load(std::memory_order_relaxed);
+        // until the first buffer is mixed, trust the requested size
+        const int buffer_frames = frames > 0 ? frames : config::audio_buffer_size;
+        return buffer_frames * OUTPUT_BUFFER_COUNT * 1000 / sample_rate;
     }
 
     bool init() {
-        logger->debug("Opening audio device");
-        if (Mix_OpenAudioDevice(44100, MIX_DEFAULT_FORMAT, 2, 1024, nullptr, 0)) {
+        // the native rate spares a resampling stage in the driver, the device may still pick another rate
+        const bool native_rate = config::audio_sample_rate == 0;
+        const int requested_rate = native_rate ? native_sample_rate() : config::audio_sample_rate;
+        logger->debug("Opening audio device at {} Hz with {} frames buffer", requested_rate, config::audio_buffer_size);
+        if (Mix_OpenAudioDevice(requested_rate, MIX_DEFAULT_FORMAT, 2, config::audio_buffer_size, nullptr,
+                                native_rate ? SDL_AUDIO_ALLOW_FREQUENCY_CHANGE : 0)) {
             logger->error("Failed to open audio device");
             return false;
         }
+        int frequency = 0, channels = 0;
+        Uint16 format = 0;
+        if (Mix_QuerySpec(&frequency, &format, &channels)) {
+            sample_rate = frequency;
+            frame_bytes = SDL_AUDIO_BITSIZE(format) / 8 * channels;
+        }
+        music_stream.start(sample_rate);
+        preview_cache.start(sample_rate, PREVIEW_CACHE_BYTES, static_cast<size_t>(config::preview_store_mb) << 20);
+        track_cache.start(sample_rate, static_cast<size_t>(config::music_cache_mb) << 20);
+        Mix_HookMusic(on_mix_music, nullptr);
+        Mix_SetPostMix(on_post_mix, nullptr);
+        logger->info("Audio device opened at {} Hz, estimated output latency {}ms", sample_rate, output_latency_ms());
         click_sound = Mix_LoadWAV("assets/sound/click.wav");
-        hit_sound = Mix_LoadWAV("assets/sound/hitsound.wav");
+        hit_sounds.load();
 
         set_music_volume(config::music_volume);
         set_sound_volume(config::sound_volume);
 
-        Mix_HookMusicFinished([]() {
-            logger->debug("Music finished");
-            SDL_PushEvent(new SDL_Event {.type = MUSIC_FINISHED_EVENT_ID});
-        });
-
         return true;
     }
 
@@ -84,21 +246,26 @@ namespace anisette::core::audio
         config::sound_volume = sound_volume();
 
         Mix_FreeChunk(click_sound);
-        Mix_FreeChunk(hit_sound);
-        Mix_FreeMusic(current_music);
+        Mix_HookMusic(nullptr, nullptr);
+        Mix_SetPostMix(nullptr, nullptr);
+        hit_sounds.unload();
+        music_stream.shutdown();
+        preview_cache.shutdown();
+        track_cache.shutdown();
         Mix_CloseAudio();
     }
 
     void set_music_volume(uint8_t volume) {
         if (volume > MIX_MAX_VOLUME) volume = MIX_MAX_VOLUME;
         // logger->debug("Setting music volume to {}", volume);
-        Mix_VolumeMusic(volume);
+        music_volume_level.store(volume, std::memory_order_relaxed);
     }
 
     void set_sound_volume(uint8_t volume) {
         if (volume > MIX_MAX_VOLUME) volume = MIX_MAX_VOLUME;
         // logger->debug("Setting sound volume to {}", volume);
         Mix_Volume(-1, volume);
+        sound_volume_level.store(volume, std::memory_order_relaxed);
     }
 
     Mix_Chunk* load_sound(const std::string &path) {
@@ -119,57 +286,123 @@ namespace anisette::core::audio
         return true;
     }
 
-    bool play_music(const std::string &path, const std::string &display_name) {
+    bool play_music(const std::string &path, const std::string &display_name, const uint64_t content_id) {
         if (path.empty()) return false;
-        stop_music();
-        current_music = Mix_LoadMUS(path.c_str());
-        if (current_music == nullptr) {
-            logger->error("Failed to load music file: {}", path);
-            return false;
-        }
-        if (Mix_PlayMusic(current_music, 0)) {
-            logger->error("Failed to play music: {}", SDL_GetError());
-            Mix_FreeMusic(current_music);
-            return false;
+        auto track = track_cache.find(path, content_id, 0);
+        if (track == nullptr) {
+            // decoding errors only show up on the decoder thread, catch the common case here
+            std::error_code ec;
+            if (!std::filesystem::is_regular_file(path, ec)) {
+                logger->error("Failed to load music file: {}", path);
+                return false;
+            }
+            // decoded in the background while this play streams from the file, so a retry starts from memory
+            track_cache.prefetch({{path, content_id, 0}});
         }
-        // fetch music metadata
-        if (display_name.empty()) {
-            music_display_name = Mix_GetMusicTitle(current_music);
+        if (track != nullptr) {
+            logger->debug("Playing {} from the track cache", path);
+            music_stream.open(path, 0, std::move(track));
+        } else if (content_id == 0 || content_id != music_id || music_path.empty()) {
+            music_stream.open(path);
         } else {
-            music_display_name = display_name;
+            // same content as the loaded music, e.g. another difficulty of the same set: restart it without opening
+            // and decoding the file again
+            music_stream.seek(0);
         }
+        music_stream.set_paused(false);
+        music_display_name = display_name.empty() ? std::filesystem::path(path).stem().string() : display_name;
         music_path = path;
-        music_duration_ms = Mix_MusicDuration(current_music) * 1000;
+        music_id = content_id;
         logger->debug("Playing music: {}", music_display_name);
         return true;
     }
 
+    bool play_preview(const std::string &path, const std::string &display_name, const uint64_t content_id,
+                      const int preview_ms) {
+        if (path.empty()) return false;
+        // a song played recently is there whole, otherwise a prefetched clip starts at the preview point
+        const int64_t preview_frame = static_cast<int64_t>(preview_ms) * sample_rate / 1000;
+        auto clip = track_cache.find(path, content_id, 0);
+        if (clip == nullptr) clip = preview_cache.find(path, content_id, preview_ms);
+        if (clip == nullptr) {
+            std::error_code ec;
+            if (!std::filesystem::is_regular_file(path, ec)) {
+                logger->error("Failed to load music file: {}", path);
+                return false;
+            }
+        }
+        const auto frame = clip != nullptr && !clip->complete ? clip->start_frame : preview_frame;
+        // not in memory: the decoder reads the stored clip if the song was extracted, and decodes the file otherwise
+        const auto clip_file = clip == nullptr ? preview_cache.stored_path(content_id, preview_ms) : std::string();
+        logger->debug("Playing preview: {} ({})", display_name, clip != nullptr ? "from memory" : "from disk or file");
+        music_stream.open(path, frame, std::move(clip), true, clip_file);
+        music_stream.set_paused(false);
+        music_display_name = display_name;
+        music_path = path;
+        music_id = content_id;
+        return true;
+    }
+
+    void prefetch_previews(std::vector<PreviewRequest> requests) {
+        preview_cache.prefetch(std::move(requests));
+    }
+
+    void update_preview_store() {
+        // wait for the first scan, partial snapshots would restart the backlog for every published directory
+        if (!beatmap_loader->is_scan_finished() || beatmap_loader->generation() == preview_store_generation) return;
+        const auto library = beatmap_loader->snapshot();
+        preview_store_generation = library->generation;
+        std::vector<PreviewRequest> requests;
+        std::unordered_set<uint64_t> seen;
+        for (uint32_t slot = 0; slot < library->size(); slot++) {
+            const auto &record = library->record(slot);
+            // difficulties of a set usually share the music and the preview point
+            if (record.music_id == 0 || !seen.insert(record.music_id ^ record.preview_point).second) continue;
+            const auto beatmap = library->get(slot);
+            requests.push_back({beatmap.music_path, beatmap.music_id, static_cast<int>(beatmap.preview_point)});
+        }
+        logger->debug("Checking the stored previews of {} songs", requests.size());
+        preview_cache.extract(std::move(requests));
+    }
+
+    void set_music_rate(const int percent) {
+        const int rate = std::clamp(percent, MIN_MUSIC_RATE, MAX_MUSIC_RATE);
+        if (rate == music_stream.rate()) return;
+        logger->debug("Music rate set to {}%", rate);
+        music_stream.set_rate(rate);
+    }
+
+    int music_rate() {
+        return music_stream.rate();
+    }
+
     void pause_music() {
-        if (current_music == nullptr) return;
+        if (music_path.empty()) return;
         logger->debug("Pausing music: {}", music_display_name);
-        Mix_PauseMusic();
+        music_stream.set_paused(true);
     }
 
     void resume_music() {
-        if (current_music == nullptr) return;
+        if (music_path.empty()) return;
         logger->debug("Resuming music: {}", music_display_name);
-        Mix_ResumeMusic();
+        music_stream.set_paused(false);
     }
 
     void stop_music() {
-        if (current_music == nullptr) return;
+        if (music_path.empty()) return;
         logger->debug("Stopping music: {}", music_display_name);
-        Mix_FreeMusic(current_music);
-        current_music = nullptr;
+        music_stream.close();
         music_display_name = "";
         music_path = "";
+        music_id = 0;
     }
 
-    void seek_music(int position_ms) {
-        if (current_music == nullptr) return;
-        if (position_ms < 0 || position_ms > music_duration_ms) return;
+    void seek_music(const int position_ms) {
+        if (music_path.empty()) return;
+        if (position_ms < 0) return;
+        // returns at once, the decoder clamps to the length once the file is open and seeks with its frame index
         logger->debug("Seeking music: {} to {}ms", music_display_name, position_ms);
-        Mix_SetMusicPosition(static_cast<double>(position_ms) / 1000);
+        music_stream.seek(static_cast<int64_t>(position_ms) * sample_rate / 1000);
         if (is_paused()) resume_music();
     }
 }
\ No newline at end of file
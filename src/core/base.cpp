@@ -76,6 +76,7 @@ namespace anisette::core
                 case SDL_QUIT:
                 case SDL_KEYDOWN:
                 case SDL_KEYUP:
+                case SDL_TEXTINPUT:
                 case SDL_MOUSEBUTTONDOWN:
                 case SDL_MOUSEBUTTONUP:
                 case SDL_MOUSEWHEEL:
@@ -89,7 +90,8 @@ namespace anisette::core
         // post-init task
         logger->debug("Running post-init tasks");
         background_instance = new components::Background(video::renderer);
-        beatmap_loader->scan(data::BY_DIFFICULTY, true);
+        beatmap_loader->scan(config::scan_workers);
+        beatmap_loader->watch();
         reload_config();
         open(register_function(video::renderer));
         return true;
@@ -118,9 +120,9 @@ namespace anisette::core
         config::save();
     }
 
-    void load_background(const std::string &path, const uint64_t &now) {
+    void load_background(const std::string &path, const uint64_t &now, const uint64_t content_id) {
         if (background_instance) {
-            background_instance->load(path, now);
+            background_instance->load(path, now, content_id);
         } else {
             logger->error("Background instance is not initialized");
         }
@@ -3,6 +3,7 @@
 //
 #include "config.h"
 #include "logging.h"
+#include <algorithm>
 #include <fstream>
 #include <SDL2/SDL_events.h>
 #include <rapidjson/document.h>
@@ -26,6 +27,12 @@ namespace anisette::core::config
     uint8_t music_volume = 128;
     bool show_frametime_overlay = true;
     bool enable_discord_rpc = true;
+    int scan_workers = 0; // 0 = use all hardware threads
+    int audio_buffer_size = 1024; // sample frames per device buffer, a power of two from 256 to 2048
+    int audio_sample_rate = 44100; // 0 = use the native rate of the output device
+    int music_cache_mb = 256; // RAM for decoded tracks kept for retries, 0 = disabled
+    int preview_store_mb = 256; // disk for preview clips extracted after the library scan, 0 = disabled
+    int texture_cache_mb = 256; // VRAM for images kept after they are no longer shown, 0 = disabled
 
     bool load() {
         // load config file
@@ -61,6 +68,23 @@ namespace anisette::core::config
                         sound_volume = it->value.GetUint();
                     } else if (strcmp(key, "music_volume") == 0) {
                         music_volume = it->value.GetUint();
+                    } else if (strcmp(key, "scan_workers") == 0) {
+                        scan_workers = it->value.GetInt();
+                        if (scan_workers < 0) scan_workers = 0;
+                    } else if (strcmp(key, "audio_buffer_size") == 0) {
+                        // round down to a power of two, smaller buffers lower the latency but may crackle
+                        const int requested = std::clamp(it->value.GetInt(), 256, 2048);
+                        audio_buffer_size = 256;
+                        while (audio_buffer_size * 2 <= requested) audio_buffer_size *= 2;
+                    } else if (strcmp(key, "audio_sample_rate") == 0) {
+                        audio_sample_rate = it->value.GetInt();
+                        if (audio_sample_rate != 0) audio_sample_rate = std::clamp(audio_sample_rate, 8000, 192000);
+                    } else if (strcmp(key, "music_cache_mb") == 0) {
+                        music_cache_mb = std::clamp(it->value.GetInt(), 0, 4096);
+                    } else if (strcmp(key, "preview_store_mb") == 0) {
+                        preview_store_mb = std::clamp(it->value.GetInt(), 0, 16384);
+                    } else if (strcmp(key, "texture_cache_mb") == 0) {
+                        texture_cache_mb = std::clamp(it->value.GetInt(), 0, 4096);
                     } else if (strcmp(key, "display_mode") == 0) {
                         switch (it->value.GetUint()) {
                             case EXCLUSIVE:
@@ -118,6 +142,12 @@ namespace anisette::core::config
         doc.AddMember("music_volume", music_volume, allocator);
         doc.AddMember("enable_discord_rpc", enable_discord_rpc, allocator);
         doc.AddMember("show_frametime_overlay", show_frametime_overlay, allocator);
+        doc.AddMember("scan_workers", scan_workers, allocator);
+        doc.AddMember("audio_buffer_size", audio_buffer_size, allocator);
+        doc.AddMember("audio_sample_rate", audio_sample_rate, allocator);
+        doc.AddMember("music_cache_mb", music_cache_mb, allocator);
+        doc.AddMember("preview_store_mb", preview_store_mb, allocator);
+        doc.AddMember("texture_cache_mb", texture_cache_mb, allocator);
         // save to file
         std::ofstream ofs(CONFIG_FILE_NAME);
         if (!ofs.is_open()) {
@@ -32,6 +32,12 @@ namespace anisette::core::config {
     extern uint8_t music_volume;
     extern bool enable_discord_rpc;
     extern bool show_frametime_overlay;
+    extern int scan_workers;
+    extern int audio_buffer_size;
+    extern int audio_sample_rate;
+    extern int music_cache_mb;
+    extern int preview_store_mb;
+    extern int texture_cache_mb;
 
     extern bool load();
     extern bool save(bool quiet = false);
@@ -11,6 +11,7 @@
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <vector>
 
 namespace anisette::core::abstract {
     class Screen {
@@ -75,7 +76,12 @@ namespace anisette::core
      */
     extern void register_first_screen(const std::function<abstract::Screen*(SDL_Renderer*)> &reg_fn);
 
-    extern void load_background(const std::string &path, const uint64_t &now);
+    /**
+     * @brief Fade to a new background image, nothing is decoded if it is the current image
+     *
+     * @param content_id Content id of the image, compared instead of the path when set
+     */
+    extern void load_background(const std::string &path, const uint64_t &now, uint64_t content_id = 0);
     extern void toggle_background_parallax(bool enable);
 } // namespace anisette::core
 
@@ -101,12 +107,36 @@ namespace anisette::core::video
 namespace anisette::core::audio
 {
     extern uint32_t MUSIC_FINISHED_EVENT_ID;
+    // playback rates in percent
+    constexpr int MIN_MUSIC_RATE = 75;
+    constexpr int MAX_MUSIC_RATE = 150;
     extern std::string music_display_name;
     extern std::string music_path;
-    extern int music_duration_ms;
+    // content id of the loaded music, 0 if unknown
+    extern uint64_t music_id;
+    // sample rate of the opened output device
+    extern int sample_rate;
 
+    /**
+     * @brief Position of the music being heard, in milliseconds
+     *
+     * Counted from the samples the mixer has consumed rather than the wall clock, so it stays in sync with the audio
+     * on long songs. In music time: at a rate of 150% it moves 1.5ms per millisecond. Call it from the main thread
+     * only, it keeps the smoothing state.
+     */
     [[nodiscard]]
     extern int music_position_ms();
+    // 0 until the decoder has opened the file
+    [[nodiscard]]
+    extern int music_duration_ms();
+    /**
+     * @brief The last music played could not be decoded
+     *
+     * play_music returns before the file is opened, a decoding error is only known once the music thread got to it.
+     * The position then stays put and the music never finishes.
+     */
+    [[nodiscard]]
+    extern bool music_failed();
     [[nodiscard]]
     extern uint8_t music_volume();
     [[nodiscard]]
@@ -114,6 +144,14 @@ namespace anisette::core::audio
     [[nodiscard]]
     extern bool is_paused();
 
+    /**
+     * @brief Time between the mixer producing a sample and the device playing it, in milliseconds
+     *
+     * Measured from the buffer size the device actually asks for, which may differ from the configured one.
+     */
+    [[nodiscard]]
+    extern int output_latency_ms();
+
     extern void set_sound_volume(uint8_t volume);
     extern void set_music_volume(uint8_t volume);
 
@@ -121,7 +159,48 @@ namespace anisette::core::audio
     extern Mix_Chunk *load_sound(const std::string &path);
     extern bool play_sound(Mix_Chunk *sound, int channel = -1);
 
-    extern bool play_music(const std::string &path, const std::string &display_name = "");
+    /**
+     * @brief Play a music file from the start
+     *
+     * Returns once the command is posted, the file is opened and decoded on the music thread.
+     *
+     * @param content_id Content id of the file, if it matches the loaded music the file is not opened again
+     */
+    extern bool play_music(const std::string &path, const std::string &display_name = "", uint64_t content_id = 0);
+
+    struct PreviewRequest {
+        std::string path;
+        uint64_t content_id = 0;
+        int preview_ms = 0;
+    };
+
+    /**
+     * @brief Play a song from its preview point, crossfading from the music playing now
+     *
+     * Starts from memory without touching the file when the preview was prefetched, and from the clip extracted to
+     * disk after the library scan otherwise. The song is only decoded when it has no clip yet.
+     */
+    extern bool play_preview(const std::string &path, const std::string &display_name, uint64_t content_id,
+                             int preview_ms);
+
+    /**
+     * @brief Decode the previews of songs likely to be played next on a background thread
+     *
+     * @param requests Ordered by priority, replaces the requests not decoded yet
+     */
+    extern void prefetch_previews(std::vector<PreviewRequest> requests);
+
+    /**
+     * @brief Play the music faster or slower, keeping its pitch
+     *
+     * Applies to the music playing now and to the next ones. Positions stay in music time, so notes follow the music
+     * at any rate.
+     *
+     * @param percent Clamped to MIN_MUSIC_RATE and MAX_MUSIC_RATE
+     */
+    extern void set_music_rate(int percent);
+    [[nodiscard]]
+    extern int music_rate();
     extern void pause_music();
     extern void resume_music();
     extern void stop_music();
@@ -129,5 +208,13 @@ namespace anisette::core::audio
 
     // for quick launch sound
     void play_click_sound();
-    void play_hit_sound();
+
+    /**
+     * @brief Play the hit sound of a stage channel, chords and fast streams do not cut each other off
+     *
+     * @param channel Stage channel with its own sample, -1 for the default one
+     * @param hit False for the miss sound
+     * @param time Performance counter of the input, 0 for now. Sounds are scheduled with the spacing of their inputs
+     */
+    void play_hit_sound(int channel = -1, bool hit = true, uint64_t time = 0);
 } // namespace anisette::core::audio
@@ -55,6 +55,7 @@ namespace anisette::core {
             // poll discord rpc
             if (start_frame > next_discord_poll) {
                 utils::discord::poll();
+                audio::update_preview_store();
                 next_discord_poll = start_frame + system_freq / 2;
             }
 
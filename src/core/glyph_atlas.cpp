@@ -0,0 +1,212 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "glyph_atlas.h"
+#include "core.h"
+#include "logging.h"
+#include <algorithm>
+#include <memory>
+
+#define ATLAS_PAGE_SIZE 1024
+// transparent pixels between glyphs, so linear filtering never samples a neighbour
+#define GLYPH_PADDING 1
+#define FIRST_PRINTABLE 32
+#define LAST_PRINTABLE 126
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+const auto logger = anisette::logging::get("glyph_atlas");
+namespace anisette::core::video
+{
+    static std::vector<std::unique_ptr<GlyphAtlas>> atlases;
+
+    // decode the code point at pos and move past it, malformed sequences read as the replacement character
+    static uint32_t next_codepoint(const std::string_view text, size_t &pos) {
+        const auto lead = static_cast<uint8_t>(text[pos++]);
+        if (lead < 0x80) return lead;
+        int length;
+        uint32_t codepoint;
+        if ((lead & 0xE0) == 0xC0) {
+            length = 1;
+            codepoint = lead & 0x1F;
+        } else if ((lead & 0xF0) == 0xE0) {
+            length = 2;
+            codepoint = lead & 0x0F;
+        } else if ((lead & 0xF8) == 0xF0) {
+            length = 3;
+            codepoint = lead & 0x07;
+        } else {
+            return REPLACEMENT_CHARACTER;
+        }
+        for (int i = 0; i < length; i++) {
+            if (pos >= text.size() || (static_cast<uint8_t>(text[pos]) & 0xC0) != 0x80) return REPLACEMENT_CHARACTER;
+            codepoint = codepoint << 6 | (static_cast<uint8_t>(text[pos++]) & 0x3F);
+        }
+        return codepoint > 0x10FFFF ? REPLACEMENT_CHARACTER : codepoint;
+    }
+
+    GlyphAtlas::GlyphAtlas(SDL_Renderer *renderer, TTF_Font *font, const int size)
+        : renderer(renderer), font(font), size(size) {
+        TTF_SetFontSize(font, size);
+        height = TTF_FontHeight(font);
+        for (uint32_t c = FIRST_PRINTABLE; c <= LAST_PRINTABLE; c++) {
+            ascii[c] = rasterize(c);
+        }
+        constexpr int count = LAST_PRINTABLE - FIRST_PRINTABLE + 1;
+        ascii_kerning.assign(count * count, 0);
+        for (int a = 0; a < count; a++) {
+            for (int b = 0; b < count; b++) {
+                const int value = TTF_GetFontKerningSizeGlyphs32(font, a + FIRST_PRINTABLE, b + FIRST_PRINTABLE);
+                ascii_kerning[a * count + b] = static_cast<int8_t>(std::clamp(value, -128, 127));
+            }
+        }
+        logger->debug("Created atlas for font size {}, {} page(s)", size, pages.size());
+    }
+
+    GlyphAtlas::~GlyphAtlas() {
+        for (const auto page : pages) {
+            SDL_DestroyTexture(page);
+        }
+    }
+
+    GlyphAtlas *GlyphAtlas::get(TTF_Font *font, const int size) {
+        if (font == nullptr) return nullptr;
+        for (const auto &atlas : atlases) {
+            if (atlas->font == font && atlas->size == size) return atlas.get();
+        }
+        return atlases.emplace_back(std::make_unique<GlyphAtlas>(video::renderer, font, size)).get();
+    }
+
+    void GlyphAtlas::clear() {
+        atlases.clear();
+    }
+
+    bool GlyphAtlas::add_page() {
+        SDL_Texture *page = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                              ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+        if (page == nullptr) {
+            logger->error("Create glyph atlas page failed: {}", SDL_GetError());
+            return false;
+        }
+        // static textures start undefined, the padding has to be transparent
+        const std::vector<uint32_t> blank(ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE, 0);
+        SDL_UpdateTexture(page, nullptr, blank.data(), ATLAS_PAGE_SIZE * sizeof(uint32_t));
+        SDL_SetTextureBlendMode(page, SDL_BLENDMODE_BLEND);
+        pages.push_back(page);
+        vertices.resize(pages.size());
+        shelf_x = shelf_y = shelf_height = 0;
+        return true;
+    }
+
+    GlyphAtlas::Glyph GlyphAtlas::rasterize(const uint32_t codepoint) {
+        Glyph glyph;
+        int min_x, max_x, min_y, max_y;
+        TTF_SetFontSize(font, size);
+        if (!TTF_GlyphIsProvided32(font, codepoint) ||
+            TTF_GlyphMetrics32(font, codepoint, &min_x, &max_x, &min_y, &max_y, &glyph.advance)) {
+            return glyph;
+        }
+        // rendered as in a line of text: as tall as the font, shifted right when it starts left of the pen
+        SDL_Surface *surface = TTF_RenderGlyph32_Blended(font, codepoint, {255, 255, 255, 255});
+        if (surface == nullptr) return glyph;
+        glyph.offset_x = std::min(min_x, 0);
+        const int w = surface->w + GLYPH_PADDING, h = surface->h + GLYPH_PADDING;
+        if (w > ATLAS_PAGE_SIZE || h > ATLAS_PAGE_SIZE) {
+            logger->warn("Glyph U+{:04X} at size {} does not fit in an atlas page", codepoint, size);
+            SDL_FreeSurface(surface);
+            return glyph;
+        }
+        if (shelf_x + w > ATLAS_PAGE_SIZE) {
+            shelf_x = 0;
+            shelf_y += shelf_height;
+            shelf_height = 0;
+        }
+        if ((pages.empty() || shelf_y + h > ATLAS_PAGE_SIZE) && !add_page()) {
+            SDL_FreeSurface(surface);
+            return glyph;
+        }
+        SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(surface);
+        if (converted == nullptr) return glyph;
+        glyph.page = static_cast<int>(pages.size()) - 1;
+        glyph.rect = {shelf_x, shelf_y, converted->w, converted->h};
+        SDL_UpdateTexture(pages.back(), &glyph.rect, converted->pixels, converted->pitch);
+        SDL_FreeSurface(converted);
+        shelf_x += w;
+        shelf_height = std::max(shelf_height, h);
+        return glyph;
+    }
+
+    const GlyphAtlas::Glyph *GlyphAtlas::glyph(const uint32_t codepoint) {
+        if (codepoint < ascii.size()) return &ascii[codepoint];
+        auto it = others.find(codepoint);
+        if (it == others.end()) {
+            it = others.emplace(codepoint, rasterize(codepoint)).first;
+        }
+        return &it->second;
+    }
+
+    int GlyphAtlas::kerning(const uint32_t previous, const uint32_t codepoint) const {
+        if (previous < FIRST_PRINTABLE || previous > LAST_PRINTABLE ||
+            codepoint < FIRST_PRINTABLE || codepoint > LAST_PRINTABLE) {
+            return 0;
+        }
+        constexpr int count = LAST_PRINTABLE - FIRST_PRINTABLE + 1;
+        return ascii_kerning[(previous - FIRST_PRINTABLE) * count + (codepoint - FIRST_PRINTABLE)];
+    }
+
+    void GlyphAtlas::measure(const std::string_view text, int &w, int &h) {
+        int pen = 0, right = 0;
+        uint32_t previous = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            const uint32_t codepoint = next_codepoint(text, pos);
+            const Glyph *g = glyph(codepoint);
+            pen += kerning(previous, codepoint);
+            right = std::max(right, pen + g->offset_x + g->rect.w);
+            pen += g->advance;
+            previous = codepoint;
+        }
+        w = std::max(pen, right);
+        h = text.empty() ? 0 : height;
+    }
+
+    void GlyphAtlas::draw(const std::string_view text, const int x, const int y, const SDL_Color color,
+                          const int max_width) {
+        for (auto &batch : vertices) batch.clear();
+        int pen = 0;
+        uint32_t previous = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            const uint32_t codepoint = next_codepoint(text, pos);
+            const Glyph *g = glyph(codepoint);
+            pen += kerning(previous, codepoint);
+            previous = codepoint;
+            const int left = pen + g->offset_x;
+            pen += g->advance;
+            if (g->page < 0) continue;
+            if (left + g->rect.w > max_width) break;
+
+            const float x0 = static_cast<float>(x + left), y0 = static_cast<float>(y);
+            const float x1 = x0 + static_cast<float>(g->rect.w), y1 = y0 + static_cast<float>(g->rect.h);
+            const float u0 = static_cast<float>(g->rect.x) / ATLAS_PAGE_SIZE;
+            const float v0 = static_cast<float>(g->rect.y) / ATLAS_PAGE_SIZE;
+            const float u1 = static_cast<float>(g->rect.x + g->rect.w) / ATLAS_PAGE_SIZE;
+            const float v1 = static_cast<float>(g->rect.y + g->rect.h) / ATLAS_PAGE_SIZE;
+            auto &batch = vertices[g->page];
+            batch.push_back({{x0, y0}, color, {u0, v0}});
+            batch.push_back({{x1, y0}, color, {u1, v0}});
+            batch.push_back({{x1, y1}, color, {u1, v1}});
+            batch.push_back({{x0, y1}, color, {u0, v1}});
+        }
+
+        for (size_t page = 0; page < pages.size(); page++) {
+            const auto &batch = vertices[page];
+            if (batch.empty()) continue;
+            // two triangles per quad, the index list only grows to the longest text drawn
+            for (auto quad = static_cast<int>(indices.size() / 6); quad < static_cast<int>(batch.size() / 4); quad++) {
+                const int base = quad * 4;
+                indices.insert(indices.end(), {base, base + 1, base + 2, base, base + 2, base + 3});
+            }
+            SDL_RenderGeometry(renderer, pages[page], batch.data(), static_cast<int>(batch.size()), indices.data(),
+                               static_cast<int>(batch.size() / 4 * 6));
+        }
+    }
+} // namespace anisette::core::video
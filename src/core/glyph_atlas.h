@@ -0,0 +1,87 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <SDL2/SDL_render.h>
+#include <SDL2/SDL_ttf.h>
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace anisette::core::video
+{
+    /**
+     * @brief Glyphs of a font at one size, rasterized once and packed into shared textures
+     *
+     * Printable ASCII is rasterized when the atlas is created, other characters the first time they are drawn. Strings
+     * are drawn as textured quads, batched into one geometry call per texture, so changing a text costs neither
+     * rasterization nor texture allocation.
+     */
+    class GlyphAtlas {
+    public:
+        struct Glyph {
+            int page = -1;
+            // in the page, the quad is drawn offset_x pixels from the pen position
+            SDL_Rect rect {};
+            int offset_x = 0;
+            int advance = 0;
+        };
+
+        GlyphAtlas(SDL_Renderer *renderer, TTF_Font *font, int size);
+        ~GlyphAtlas();
+        GlyphAtlas(const GlyphAtlas &) = delete;
+        GlyphAtlas &operator=(const GlyphAtlas &) = delete;
+
+        /**
+         * @brief Shared atlas of a font at a size for the main renderer, created on first use
+         *
+         * @return nullptr without a font
+         */
+        static GlyphAtlas *get(TTF_Font *font, int size);
+        // destroys every shared atlas, before the renderer and the fonts
+        static void clear();
+
+        [[nodiscard]] int line_height() const {
+            return height;
+        }
+
+        /**
+         * @brief Size of a UTF-8 string in pixels
+         */
+        void measure(std::string_view text, int &w, int &h);
+
+        /**
+         * @brief Draw a UTF-8 string to the current render target
+         *
+         * @param x, y Top left corner of the text
+         * @param max_width Glyphs ending past it are not drawn
+         */
+        void draw(std::string_view text, int x, int y, SDL_Color color, int max_width = INT_MAX);
+
+    private:
+        SDL_Renderer *renderer;
+        TTF_Font *font;
+        const int size;
+        int height = 0;
+
+        std::vector<SDL_Texture *> pages;
+        // shelf packing: glyphs are placed left to right on rows as tall as their tallest glyph
+        int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+        std::array<Glyph, 128> ascii {};
+        std::unordered_map<uint32_t, Glyph> others;
+        // kerning between printable ASCII characters, other pairs are not kerned
+        std::vector<int8_t> ascii_kerning;
+
+        // reused by every draw, one batch per page
+        std::vector<std::vector<SDL_Vertex>> vertices;
+        std::vector<int> indices;
+
+        const Glyph *glyph(uint32_t codepoint);
+        [[nodiscard]] int kerning(uint32_t previous, uint32_t codepoint) const;
+        Glyph rasterize(uint32_t codepoint);
+        bool add_page();
+    };
+} // namespace anisette::core::video
@@ -0,0 +1,105 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "hit_sounds.h"
+#include "logging.h"
+#include <algorithm>
+#include <filesystem>
+#include <string>
+
+#define DEFAULT_HIT_SOUND "assets/sound/hitsound.wav"
+// optional, hit_0.wav to hit_5.wav replace the default sample of one stage channel
+#define CHANNEL_HIT_SOUND_FORMAT "assets/sound/hit_{}.wav"
+// optional, no sound on a miss without it
+#define MISS_SOUND "assets/sound/miss.wav"
+
+const auto logger = anisette::logging::get("hitsound");
+
+namespace anisette::core::audio
+{
+    int HitSoundEngine::load_sample(const char *path) {
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(path, ec)) return -1;
+        // SDL_mixer converts the sample to the output format, nothing is resampled while mixing
+        Mix_Chunk *chunk = Mix_LoadWAV(path);
+        if (chunk == nullptr) {
+            logger->error("Failed to load hit sound {}: {}", path, SDL_GetError());
+            return -1;
+        }
+        samples.push_back(chunk);
+        return static_cast<int>(samples.size()) - 1;
+    }
+
+    void HitSoundEngine::load() {
+        const int fallback = load_sample(DEFAULT_HIT_SOUND);
+        hit_sample.fill(fallback);
+        for (int c = 0; c < HIT_SOUND_CHANNELS; c++) {
+            const int sample = load_sample(fmt::format(CHANNEL_HIT_SOUND_FORMAT, c).c_str());
+            if (sample >= 0) hit_sample[c] = sample;
+        }
+        miss_sample = load_sample(MISS_SOUND);
+        logger->debug("Loaded {} hit sound samples", samples.size());
+    }
+
+    void HitSoundEngine::unload() {
+        voices.fill({});
+        for (const auto chunk : samples) Mix_FreeChunk(chunk);
+        samples.clear();
+        hit_sample.fill(-1);
+        miss_sample = -1;
+    }
+
+    void HitSoundEngine::trigger(const int channel, const Judgement judgement, const uint64_t time) {
+        int sample;
+        if (judgement == MISS) sample = miss_sample;
+        else sample = hit_sample[channel >= 0 && channel < HIT_SOUND_CHANNELS ? channel : HIT_SOUND_CHANNELS];
+        if (sample < 0) return;
+        const uint32_t head = queue_head.load(std::memory_order_relaxed);
+        if (head - queue_tail.load(std::memory_order_acquire) >= QUEUE_SIZE) return;
+        queue[head % QUEUE_SIZE] = {time, sample};
+        queue_head.store(head + 1, std::memory_order_release);
+    }
+
+    HitSoundEngine::Voice &HitSoundEngine::free_voice() {
+        Voice *oldest = &voices[0];
+        for (auto &voice : voices) {
+            if (voice.sample == nullptr) return voice;
+            if (voice.position > oldest->position) oldest = &voice;
+        }
+        return *oldest;
+    }
+
+    void HitSoundEngine::mix(int16_t *out, const int frames, const uint64_t buffer_time, const int sample_rate,
+                             const int volume) {
+        const uint64_t freq = SDL_GetPerformanceFrequency();
+        // constant delay of one buffer, inputs of the last buffer period land at the same distance in this one
+        const uint64_t delay = static_cast<uint64_t>(frames) * freq / sample_rate;
+        const uint32_t head = queue_head.load(std::memory_order_acquire);
+        for (uint32_t tail = queue_tail.load(std::memory_order_relaxed); tail != head; tail++) {
+            const auto &[time, sample] = queue[tail % QUEUE_SIZE];
+            const uint64_t due = time + delay;
+            const uint64_t offset = due > buffer_time ? (due - buffer_time) * sample_rate / freq : 0;
+            Voice &voice = free_voice();
+            voice.sample = samples[sample];
+            voice.position = 0;
+            voice.delay = static_cast<uint32_t>(std::min<uint64_t>(offset, frames - 1));
+        }
+        queue_tail.store(head, std::memory_order_release);
+
+        for (auto &voice : voices) {
+            if (voice.sample == nullptr) continue;
+            const auto *pcm = reinterpret_cast<const int16_t *>(voice.sample->abuf);
+            const uint32_t length = voice.sample->alen / 4;
+            const uint32_t count = std::min<uint32_t>(frames - voice.delay, length - voice.position);
+            int16_t *dst = out + voice.delay * 2;
+            const int16_t *src = pcm + voice.position * 2;
+            for (uint32_t i = 0; i < count * 2; i++) {
+                const int value = dst[i] + src[i] * volume / MIX_MAX_VOLUME;
+                dst[i] = static_cast<int16_t>(std::clamp(value, -32768, 32767));
+            }
+            voice.position += count;
+            voice.delay = 0;
+            if (voice.position >= length) voice.sample = nullptr;
+        }
+    }
+} // namespace anisette::core::audio
@@ -0,0 +1,71 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <SDL2/SDL_mixer.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// stage channels with their own sample
+#define HIT_SOUND_CHANNELS 6
+
+namespace anisette::core::audio
+{
+    /**
+     * @brief Polyphonic hit sounds mixed on the audio thread
+     *
+     * Samples are decoded once to the output format, triggers reach the audio thread through a lock-free single
+     * producer single consumer queue. Every trigger is played one device buffer after its timestamp, so hits keep the
+     * spacing they were played with no matter when the callback runs. When every voice is busy, the voice that has
+     * played the longest is stolen: its sound is the quietest part of the chord.
+     */
+    class HitSoundEngine {
+    public:
+        enum Judgement { HIT, MISS };
+
+        // main thread, before the audio thread uses the engine
+        void load();
+        void unload();
+
+        /**
+         * @brief Queue a hit sound, dropped if the queue is full
+         *
+         * @param channel Stage channel, or -1 for the default sample
+         * @param time Performance counter of the input
+         */
+        void trigger(int channel, Judgement judgement, uint64_t time);
+
+        // audio thread, adds the voices to a buffer that starts at the given performance counter
+        void mix(int16_t *out, int frames, uint64_t buffer_time, int sample_rate, int volume);
+
+    private:
+        struct Trigger {
+            uint64_t time;
+            int sample;
+        };
+
+        struct Voice {
+            const Mix_Chunk *sample = nullptr;
+            // frames played, and frames of the current buffer to wait before starting
+            uint32_t position = 0;
+            uint32_t delay = 0;
+        };
+
+        static constexpr uint32_t QUEUE_SIZE = 256;
+        static constexpr int MAX_VOICES = 32;
+
+        std::vector<Mix_Chunk *> samples;
+        std::array<int, HIT_SOUND_CHANNELS + 1> hit_sample {};
+        int miss_sample = -1;
+
+        std::array<Trigger, QUEUE_SIZE> queue {};
+        std::atomic_uint32_t queue_head = 0;
+        std::atomic_uint32_t queue_tail = 0;
+        std::array<Voice, MAX_VOICES> voices {};
+
+        int load_sample(const char *path);
+        Voice &free_voice();
+    };
+} // namespace anisette::core::audio
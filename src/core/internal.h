@@ -33,4 +33,6 @@ namespace anisette::core::audio
 {
     extern bool init();
     extern void cleanup();
+    // hand the songs of a new library snapshot to the preview extraction, cheap when nothing changed
+    extern void update_preview_store();
 } // namespace anisette::core::audio
@@ -0,0 +1,645 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "music_stream.h"
+#include "logging.h"
+#include <SDL2/SDL_events.h>
+#include <SDL2/SDL_mixer.h>
+#include <SDL2/SDL_timer.h>
+#include <mpg123.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// 16-bit stereo
+#define FRAME_BYTES 4
+// about 0.7s of music at 48 kHz, must be a power of two
+#define RING_FRAMES (1 << 15)
+#define DECODE_CHUNK_FRAMES 2048
+// how long the decoder sleeps when the ring is full
+#define DECODER_POLL_MS 5
+#define CROSSFADE_MS 200
+// stretched music is mixed in chunks of this many frames
+#define STRETCH_CHUNK_FRAMES 1024
+#define CLIP_FILE_MAGIC 0x31504E41 // "ANP1"
+#define CLIP_FILE_VERSION 1
+
+const auto logger = anisette::logging::get("music");
+
+namespace anisette::core::audio
+{
+    /**
+     * @brief MP3 streamed by mpg123 and resampled by SDL when the file rate differs from the device
+     */
+    class Mp3Source final : public MusicSource {
+    public:
+        ~Mp3Source() override {
+            if (converter != nullptr) SDL_FreeAudioStream(converter);
+            if (handle != nullptr) {
+                mpg123_close(handle);
+                mpg123_delete(handle);
+            }
+        }
+
+        bool open(const std::string &path, const int sample_rate) {
+            int error = MPG123_OK;
+            handle = mpg123_new(nullptr, &error);
+            if (handle == nullptr) {
+                logger->error("Failed to create MP3 decoder: {}", mpg123_plain_strerror(error));
+                return false;
+            }
+            mpg123_param(handle, MPG123_FLAGS, MPG123_FORCE_STEREO | MPG123_GAPLESS | MPG123_QUIET, 0);
+            // let the frame index grow with the file, after the scan every seek is a lookup plus one frame of decoding
+            mpg123_param(handle, MPG123_INDEX_SIZE, -1, 0);
+            // keep the file rate, resampling is done by SDL
+            mpg123_format_none(handle);
+            const long *rates = nullptr;
+            size_t rate_count = 0;
+            mpg123_rates(&rates, &rate_count);
+            for (size_t i = 0; i < rate_count; i++) mpg123_format(handle, rates[i], MPG123_STEREO, MPG123_ENC_SIGNED_16);
+            if (mpg123_open(handle, path.c_str()) != MPG123_OK || mpg123_scan(handle) != MPG123_OK) {
+                logger->error("Failed to open {}: {}", path, mpg123_strerror(handle));
+                return false;
+            }
+            long rate = 0;
+            int channels = 0, encoding = 0;
+            if (mpg123_getformat(handle, &rate, &channels, &encoding) != MPG123_OK || rate <= 0) {
+                logger->error("Failed to read the format of {}: {}", path, mpg123_strerror(handle));
+                return false;
+            }
+            file_rate = rate;
+            output_rate = sample_rate;
+            const auto samples = static_cast<int64_t>(mpg123_length(handle));
+            total_frames = samples > 0 ? samples * output_rate / file_rate : 0;
+            if (file_rate != output_rate) {
+                converter = SDL_NewAudioStream(AUDIO_S16SYS, 2, static_cast<int>(file_rate), AUDIO_S16SYS, 2, sample_rate);
+                if (converter == nullptr) {
+                    logger->error("Failed to create resampler for {}: {}", path, SDL_GetError());
+                    return false;
+                }
+                buffer.resize(DECODE_CHUNK_FRAMES * 2);
+            }
+            return true;
+        }
+
+        size_t read(int16_t *out, const size_t max_frames) override {
+            const size_t wanted = max_frames * FRAME_BYTES;
+            if (converter == nullptr) return decode(out, wanted) / FRAME_BYTES;
+            while (!file_done && static_cast<size_t>(SDL_AudioStreamAvailable(converter)) < wanted) {
+                const size_t bytes = decode(buffer.data(), buffer.size() * sizeof(int16_t));
+                if (bytes == 0) {
+                    file_done = true;
+                    SDL_AudioStreamFlush(converter);
+                    break;
+                }
+                SDL_AudioStreamPut(converter, buffer.data(), static_cast<int>(bytes));
+            }
+            const int got = SDL_AudioStreamGet(converter, out, static_cast<int>(wanted));
+            return got > 0 ? static_cast<size_t>(got) / FRAME_BYTES : 0;
+        }
+
+        bool seek(const int64_t frame) override {
+            if (mpg123_seek(handle, static_cast<off_t>(frame * file_rate / output_rate), SEEK_SET) < 0) return false;
+            if (converter != nullptr) SDL_AudioStreamClear(converter);
+            file_done = false;
+            return true;
+        }
+
+        [[nodiscard]] int64_t length() const override {
+            return total_frames;
+        }
+
+    private:
+        mpg123_handle *handle = nullptr;
+        SDL_AudioStream *converter = nullptr;
+        std::vector<int16_t> buffer;
+        int64_t file_rate = 0, output_rate = 0, total_frames = 0;
+        bool file_done = false;
+
+        // bytes decoded at the file rate, 0 at the end or on error
+        size_t decode(void *out, const size_t bytes) const {
+            size_t done = 0;
+            int result;
+            // a format change is reported once with no data, the format itself is forced
+            while ((result = mpg123_read(handle, out, bytes, &done)) == MPG123_NEW_FORMAT && done == 0) {}
+            if (result != MPG123_OK && result != MPG123_DONE && result != MPG123_NEW_FORMAT) {
+                logger->warn("MP3 decoding stopped: {}", mpg123_strerror(handle));
+            }
+            return done;
+        }
+    };
+
+    /**
+     * @brief Music decoded whole by SDL_mixer, for the formats mpg123 does not read
+     */
+    class ChunkSource final : public MusicSource {
+    public:
+        explicit ChunkSource(Mix_Chunk *chunk) : chunk(chunk), total_frames(chunk->alen / FRAME_BYTES) {}
+
+        ~ChunkSource() override {
+            Mix_FreeChunk(chunk);
+        }
+
+        size_t read(int16_t *out, const size_t max_frames) override {
+            const auto frames = static_cast<size_t>(std::min<int64_t>(static_cast<int64_t>(max_frames),
+                                                                      total_frames - offset));
+            std::memcpy(out, chunk->abuf + offset * FRAME_BYTES, frames * FRAME_BYTES);
+            offset += static_cast<int64_t>(frames);
+            return frames;
+        }
+
+        bool seek(const int64_t frame) override {
+            offset = std::clamp<int64_t>(frame, 0, total_frames);
+            return true;
+        }
+
+        [[nodiscard]] int64_t length() const override {
+            return total_frames;
+        }
+
+    private:
+        Mix_Chunk *chunk;
+        int64_t total_frames;
+        int64_t offset = 0;
+    };
+
+    /**
+     * @brief Song starting from a decoded clip, the file is opened when playback leaves the clip
+     */
+    class ClipSource final : public MusicSource {
+    public:
+        ClipSource(std::shared_ptr<const PcmClip> clip, const int sample_rate)
+            : clip(std::move(clip)), sample_rate(sample_rate), offset(this->clip->start_frame) {}
+
+        size_t read(int16_t *out, const size_t max_frames) override {
+            const int64_t clip_end = clip->start_frame + clip->frames();
+            if (file == nullptr && offset >= clip->start_frame && offset < clip_end) {
+                const auto frames = static_cast<size_t>(std::min<int64_t>(static_cast<int64_t>(max_frames),
+                                                                          clip_end - offset));
+                std::memcpy(out, clip->pcm.data() + (offset - clip->start_frame) * 2, frames * FRAME_BYTES);
+                offset += static_cast<int64_t>(frames);
+                return frames;
+            }
+            if (clip->complete || !open_file()) return 0;
+            const size_t frames = file->read(out, max_frames);
+            offset += static_cast<int64_t>(frames);
+            return frames;
+        }
+
+        bool seek(const int64_t frame) override {
+            offset = frame;
+            if (frame >= clip->start_frame && frame < clip->start_frame + clip->frames()) {
+                file.reset();
+                return true;
+            }
+            if (clip->complete) {
+                offset = std::clamp(frame, clip->start_frame, clip->start_frame + clip->frames());
+                return true;
+            }
+            return open_file();
+        }
+
+        [[nodiscard]] int64_t length() const override {
+            if (clip->complete) return clip->start_frame + clip->frames();
+            return file != nullptr ? file->length() : 0;
+        }
+
+    private:
+        std::shared_ptr<const PcmClip> clip;
+        std::unique_ptr<MusicSource> file;
+        int sample_rate;
+        int64_t offset;
+
+        bool open_file() {
+            if (file != nullptr) return true;
+            file = open_music_source(clip->path, sample_rate);
+            return file != nullptr && file->seek(offset);
+        }
+    };
+
+    struct ClipFileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sample_rate;
+        uint32_t frames;
+        int64_t start_frame;
+    };
+
+    // reads and checks the header, the file size included so the data can be allocated for safely
+    static bool read_clip_header(std::ifstream &ifs, const std::string &file, const int sample_rate,
+                                 ClipFileHeader &header) {
+        if (!ifs.is_open() || !ifs.read(reinterpret_cast<char *>(&header), sizeof(header))) return false;
+        if (header.magic != CLIP_FILE_MAGIC || header.version != CLIP_FILE_VERSION) return false;
+        if (header.sample_rate != static_cast<uint32_t>(sample_rate) || header.start_frame < 0) return false;
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(file, ec);
+        if (ec || size != sizeof(header) + static_cast<uint64_t>(header.frames) * FRAME_BYTES) {
+            logger->warn("Corrupted clip file: {}", file);
+            return false;
+        }
+        return true;
+    }
+
+    bool clip_file_valid(const std::string &file, const int sample_rate) {
+        std::ifstream ifs(file, std::ios::binary);
+        ClipFileHeader header {};
+        return read_clip_header(ifs, file, sample_rate, header);
+    }
+
+    std::shared_ptr<PcmClip> read_clip_file(const std::string &file, const std::string &path, const int sample_rate) {
+        std::ifstream ifs(file, std::ios::binary);
+        ClipFileHeader header {};
+        if (!read_clip_header(ifs, file, sample_rate, header)) return nullptr;
+        auto clip = std::make_shared<PcmClip>();
+        clip->path = path;
+        clip->start_frame = header.start_frame;
+        clip->pcm.resize(static_cast<size_t>(header.frames) * 2);
+        const auto bytes = static_cast<std::streamsize>(header.frames) * FRAME_BYTES;
+        if (!ifs.read(reinterpret_cast<char *>(clip->pcm.data()), bytes)) return nullptr;
+        return clip;
+    }
+
+    bool write_clip_file(const std::string &file, const PcmClip &clip, const int sample_rate) {
+        ClipFileHeader header {};
+        header.magic = CLIP_FILE_MAGIC;
+        header.version = CLIP_FILE_VERSION;
+        header.sample_rate = static_cast<uint32_t>(sample_rate);
+        header.frames = static_cast<uint32_t>(clip.frames());
+        header.start_frame = clip.start_frame;
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(file).parent_path(), ec);
+        // write to a temporary file first, so a crash never leaves a half-written clip behind
+        const auto temp_path = file + ".tmp";
+        {
+            std::ofstream ofs(temp_path, std::ios::binary | std::ios::trunc);
+            if (!ofs.is_open()) {
+                logger->error("Failed to open clip file for writing: {}", temp_path);
+                return false;
+            }
+            ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            const auto bytes = static_cast<std::streamsize>(header.frames) * FRAME_BYTES;
+            ofs.write(reinterpret_cast<const char *>(clip.pcm.data()), bytes);
+            if (!ofs.good()) {
+                logger->error("Failed to write clip file: {}", temp_path);
+                ofs.close();
+                std::filesystem::remove(temp_path, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(temp_path, file, ec);
+        if (ec) {
+            logger->error("Failed to commit clip file {}: {}", file, ec.message());
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+        return true;
+    }
+
+    std::unique_ptr<MusicSource> open_music_source(const std::string &path, const int sample_rate) {
+        auto extension = std::filesystem::path(path).extension().string();
+        for (auto &c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (extension == ".mp3") {
+            auto source = std::make_unique<Mp3Source>();
+            if (!source->open(path, sample_rate)) return nullptr;
+            return source;
+        }
+        // SDL_mixer converts chunks to the device format
+        Mix_Chunk *chunk = Mix_LoadWAV(path.c_str());
+        if (chunk == nullptr) {
+            logger->error("Failed to decode {}: {}", path, SDL_GetError());
+            return nullptr;
+        }
+        return std::make_unique<ChunkSource>(chunk);
+    }
+
+    MusicStream::MusicStream(const uint32_t finished_event) : finished_event(finished_event) {}
+
+    MusicStream::~MusicStream() {
+        shutdown();
+    }
+
+    void MusicStream::start(const int sample_rate) {
+        this->sample_rate = sample_rate;
+        crossfade_frames = static_cast<int64_t>(sample_rate) * CROSSFADE_MS / 1000;
+        ring.assign(static_cast<size_t>(RING_FRAMES) * 2, 0);
+        stretcher.start(sample_rate);
+        stretch_buffer.assign(STRETCH_CHUNK_FRAMES * 2, 0);
+        decoder = std::thread([this]() { run(); });
+    }
+
+    void MusicStream::shutdown() {
+        if (!decoder.joinable()) return;
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        decoder.join();
+    }
+
+    void MusicStream::post(Command &&command) {
+        command.serial = ++serial;
+        target_frame = command.frame;
+        serial_published.store(serial, std::memory_order_release);
+        {
+            std::lock_guard lock(mutex);
+            // a seek right after an open is applied by the open, the file is not opened twice
+            if (pending && pending->open && !command.open && !command.close) {
+                pending->frame = command.frame;
+                pending->serial = command.serial;
+            } else {
+                pending = std::move(command);
+            }
+        }
+        wake.notify_one();
+    }
+
+    void MusicStream::open(const std::string &path, const int64_t frame, std::shared_ptr<const PcmClip> clip,
+                           const bool crossfade, const std::string &clip_file) {
+        post({.open = true, .crossfade = crossfade, .path = path, .clip = std::move(clip), .clip_file = clip_file,
+              .frame = std::max<int64_t>(frame, 0)});
+        open_serial = serial;
+    }
+
+    void MusicStream::seek(const int64_t frame) {
+        post({.frame = std::max<int64_t>(frame, 0)});
+    }
+
+    void MusicStream::close() {
+        post({.close = true});
+    }
+
+    void MusicStream::set_paused(const bool state) {
+        paused_flag.store(state, std::memory_order_relaxed);
+    }
+
+    bool MusicStream::paused() const {
+        return paused_flag.load(std::memory_order_relaxed);
+    }
+
+    void MusicStream::set_rate(const int percent) {
+        rate_percent.store(percent, std::memory_order_relaxed);
+    }
+
+    int MusicStream::rate() const {
+        return rate_percent.load(std::memory_order_relaxed);
+    }
+
+    uint32_t MusicStream::requested_serial() const {
+        return serial;
+    }
+
+    int64_t MusicStream::requested_frame() const {
+        return target_frame;
+    }
+
+    bool MusicStream::open_failed() const {
+        return open_serial != 0 && failed_serial.load(std::memory_order_acquire) >= open_serial;
+    }
+
+    uint32_t MusicStream::applied_serial() const {
+        return applied.load(std::memory_order_acquire);
+    }
+
+    int64_t MusicStream::position() const {
+        return played_frames.load(std::memory_order_relaxed);
+    }
+
+    bool MusicStream::running() const {
+        return mixing.load(std::memory_order_relaxed);
+    }
+
+    int64_t MusicStream::length() const {
+        return source_length.load(std::memory_order_relaxed);
+    }
+
+    void MusicStream::publish_flush(const int64_t frame, const uint32_t command_serial, const bool crossfade) {
+        end_pos.store(UINT64_MAX, std::memory_order_relaxed);
+        const uint32_t sequence = flush_sequence.load(std::memory_order_relaxed);
+        flush_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        flush_pos.store(write_pos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        flush_frame.store(frame, std::memory_order_relaxed);
+        flush_serial.store(command_serial, std::memory_order_relaxed);
+        flush_crossfade.store(crossfade, std::memory_order_relaxed);
+        flush_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void MusicStream::apply(const Command &command, std::unique_ptr<MusicSource> &source, bool &exhausted) {
+        if (command.close) {
+            source.reset();
+            source_length.store(-1, std::memory_order_relaxed);
+            publish_flush(-1, command.serial);
+            return;
+        }
+        if (command.open) {
+            const uint64_t start = SDL_GetPerformanceCounter();
+            std::shared_ptr<const PcmClip> clip = command.clip;
+            if (clip == nullptr && !command.clip_file.empty()) {
+                clip = read_clip_file(command.clip_file, command.path, sample_rate);
+            }
+            if (clip != nullptr) source = std::make_unique<ClipSource>(clip, sample_rate);
+            else source = open_music_source(command.path, sample_rate);
+            source_length.store(source ? source->length() : -1, std::memory_order_relaxed);
+            if (source) {
+                logger->debug("Opened {} in {}ms", command.path,
+                              (SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency());
+            } else {
+                logger->error("Failed to open music file: {}", command.path);
+                failed_serial.store(command.serial, std::memory_order_release);
+            }
+        }
+        if (!source) {
+            publish_flush(-1, command.serial);
+            return;
+        }
+        int64_t frame = command.frame;
+        if (source->length() > 0) frame = std::min(frame, source->length());
+        if (!source->seek(frame)) logger->warn("Failed to seek to frame {}", frame);
+        exhausted = false;
+        publish_flush(frame, command.serial, command.crossfade);
+    }
+
+    void MusicStream::run() {
+        std::unique_ptr<MusicSource> source;
+        bool exhausted = true;
+        std::vector<int16_t> chunk(DECODE_CHUNK_FRAMES * 2);
+        std::unique_lock lock(mutex);
+        while (!stopping) {
+            if (pending) {
+                const Command command = std::move(*pending);
+                pending.reset();
+                lock.unlock();
+                apply(command, source, exhausted);
+                lock.lock();
+                continue;
+            }
+            if (!source || exhausted) {
+                wake.wait(lock, [this]() { return stopping || pending.has_value(); });
+                continue;
+            }
+            const uint64_t write = write_pos.load(std::memory_order_relaxed);
+            if (RING_FRAMES - (write - read_pos.load(std::memory_order_acquire)) < DECODE_CHUNK_FRAMES) {
+                wake.wait_for(lock, std::chrono::milliseconds(DECODER_POLL_MS));
+                continue;
+            }
+            lock.unlock();
+            const size_t frames = source->read(chunk.data(), DECODE_CHUNK_FRAMES);
+            for (size_t done = 0; done < frames;) {
+                const size_t offset = (write + done) & (RING_FRAMES - 1);
+                const size_t count = std::min<size_t>(frames - done, RING_FRAMES - offset);
+                std::memcpy(ring.data() + offset * 2, chunk.data() + done * 2, count * FRAME_BYTES);
+                done += count;
+            }
+            write_pos.store(write + frames, std::memory_order_release);
+            if (frames == 0) {
+                exhausted = true;
+                end_pos.store(write, std::memory_order_release);
+            }
+            lock.lock();
+        }
+        lock.unlock();
+        source.reset();
+    }
+
+    // add frames of the ring, or of a plain buffer with an all-ones mask, to the output. The gain moves by step after
+    // every frame
+    static void add_frames(int16_t *out, const int16_t *ring, const uint64_t pos, const uint64_t count, float gain,
+                           const float step, const uint64_t mask = RING_FRAMES - 1) {
+        for (uint64_t i = 0; i < count; i++, gain += step) {
+            const int16_t *frame = ring + ((pos + i) & mask) * 2;
+            for (int c = 0; c < 2; c++) {
+                const int sample = out[i * 2 + c] + static_cast<int>(static_cast<float>(frame[c]) * gain);
+                out[i * 2 + c] = static_cast<int16_t>(std::clamp(sample, -32768, 32767));
+            }
+        }
+    }
+
+    uint64_t MusicStream::stretch(int16_t *out, const uint64_t frames, const uint64_t written) {
+        uint64_t done = 0;
+        while (true) {
+            done += stretcher.output(out + done * 2, frames - done);
+            if (done == frames) break;
+            // feed the next sequence, at most up to the end of the ring so the input is contiguous
+            const uint64_t available = written > main_read ? written - main_read : 0;
+            const uint64_t offset = main_read & (RING_FRAMES - 1);
+            const uint64_t count = std::min({static_cast<uint64_t>(stretcher.input_needed()), available,
+                                             RING_FRAMES - offset});
+            if (count == 0) break;
+            stretcher.feed(ring.data() + offset * 2, count);
+            main_read += count;
+        }
+        return done;
+    }
+
+    void MusicStream::mix(Uint8 *stream, const int length, const int volume) {
+        // loaded before the flush: data written after a flush is only visible together with that flush
+        const uint64_t written = write_pos.load(std::memory_order_acquire);
+        // catch up with the last open, seek or close of the decoder
+        uint32_t sequence, serial_seen;
+        uint64_t flushed_pos;
+        int64_t flushed_frame;
+        bool crossfade;
+        do {
+            sequence = flush_sequence.load(std::memory_order_acquire);
+            flushed_pos = flush_pos.load(std::memory_order_relaxed);
+            flushed_frame = flush_frame.load(std::memory_order_relaxed);
+            serial_seen = flush_serial.load(std::memory_order_relaxed);
+            crossfade = flush_crossfade.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while (sequence & 1 || sequence != flush_sequence.load(std::memory_order_relaxed));
+        const bool is_paused = paused_flag.load(std::memory_order_relaxed);
+        if (serial_seen != consumer_serial) {
+            // what is left of the music being heard is faded out instead of dropped
+            if (crossfade && active && !is_paused) {
+                fade_read = main_read;
+                fade_total = fade_left = std::min<int64_t>(crossfade_frames, static_cast<int64_t>(flushed_pos - main_read));
+            } else {
+                fade_left = 0;
+            }
+            fade_in = crossfade ? 0 : crossfade_frames;
+            stretching = false;
+            consumer_serial = serial_seen;
+            main_read = flushed_pos;
+            active = flushed_frame >= 0;
+            played_frames.store(std::max<int64_t>(flushed_frame, 0), std::memory_order_relaxed);
+            finish_signalled = false;
+            applied.store(serial_seen, std::memory_order_release);
+        }
+        if (is_paused) {
+            mixing.store(false, std::memory_order_relaxed);
+            return;
+        }
+
+        auto *out = reinterpret_cast<int16_t *>(stream);
+        const uint64_t wanted = static_cast<uint64_t>(length) / FRAME_BYTES;
+        const float level = static_cast<float>(volume) / MIX_MAX_VOLUME;
+        if (fade_left > 0) {
+            const auto count = std::min<uint64_t>(fade_left, wanted);
+            const float step = level / static_cast<float>(fade_total);
+            add_frames(out, ring.data(), fade_read, count, step * static_cast<float>(fade_left), -step);
+            fade_read += count;
+            fade_left -= static_cast<int64_t>(count);
+        }
+        // the new music fades in over the first frames after a crossfade
+        const auto add_main = [&](int16_t *dst, const int16_t *src, const uint64_t pos, const uint64_t count,
+                                  const uint64_t mask) {
+            const auto ramp = std::min<uint64_t>(count, crossfade_frames - fade_in);
+            const float step = level / static_cast<float>(crossfade_frames);
+            add_frames(dst, src, pos, ramp, step * static_cast<float>(fade_in), step, mask);
+            add_frames(dst + ramp * 2, src, pos + ramp, count - ramp, level, 0, mask);
+            fade_in += static_cast<int64_t>(ramp);
+        };
+        const int rate = rate_percent.load(std::memory_order_relaxed);
+        if (active && (stretching || rate != 100)) {
+            // the stretched position is counted from the last rate change, so it never drifts from the rate
+            if (!stretching) {
+                stretcher.reset();
+                stretching = true;
+                stretch_base = played_frames.load(std::memory_order_relaxed) + stretcher.latency();
+                stretch_served = 0;
+            } else if (rate != stretch_rate) {
+                stretch_base += std::llround(static_cast<double>(stretch_served) * stretch_rate / 100);
+                stretch_served = 0;
+            }
+            stretch_rate = rate;
+            stretcher.set_rate(rate / 100.0);
+        }
+
+        uint64_t frames = 0;
+        if (active && stretching) {
+            while (frames < wanted) {
+                const auto chunk = std::min<uint64_t>(wanted - frames, STRETCH_CHUNK_FRAMES);
+                const auto count = stretch(stretch_buffer.data(), chunk, written);
+                add_main(out + frames * 2, stretch_buffer.data(), 0, count, UINT64_MAX);
+                frames += count;
+                // out of input, the decoder is behind or the music has ended
+                if (count < chunk) break;
+            }
+            stretch_served += frames;
+            played_frames.store(stretch_base + std::llround(static_cast<double>(stretch_served) * stretch_rate / 100),
+                                std::memory_order_relaxed);
+        } else if (active && written > main_read) {
+            // the flush may be newer than the write position loaded above
+            frames = std::min(written - main_read, wanted);
+            add_main(out, ring.data(), main_read, frames, RING_FRAMES - 1);
+            main_read += frames;
+            played_frames.fetch_add(static_cast<int64_t>(frames), std::memory_order_relaxed);
+        }
+        read_pos.store(fade_left > 0 ? fade_read : main_read, std::memory_order_release);
+        mixing.store(frames > 0, std::memory_order_relaxed);
+
+        // an end reached while a newer command is on its way belongs to the music being replaced
+        if (active && frames < wanted && !finish_signalled && main_read == end_pos.load(std::memory_order_acquire)
+            && consumer_serial == serial_published.load(std::memory_order_acquire)) {
+            finish_signalled = true;
+            SDL_Event event {.type = finished_event};
+            SDL_PushEvent(&event);
+        }
+    }
+} // namespace anisette::core::audio
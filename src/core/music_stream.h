@@ -0,0 +1,211 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include "time_stretch.h"
+#include <SDL2/SDL_stdinc.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace anisette::core::audio
+{
+    /**
+     * @brief Decoded music in the output format, 16-bit stereo at the device rate
+     */
+    class MusicSource {
+    public:
+        virtual ~MusicSource() = default;
+
+        /**
+         * @brief Decode the next frames
+         *
+         * @return Number of frames written, 0 at the end of the music
+         */
+        virtual size_t read(int16_t *out, size_t max_frames) = 0;
+        virtual bool seek(int64_t frame) = 0;
+        // total number of frames
+        [[nodiscard]] virtual int64_t length() const = 0;
+    };
+
+    /**
+     * @brief A decoded part of a song, e.g. from its preview point, or the whole song
+     */
+    struct PcmClip {
+        std::string path;
+        // frame of the song the clip starts at
+        int64_t start_frame = 0;
+        // the clip holds the song to its end, seeks are plain offsets and the file is never opened
+        bool complete = false;
+        // interleaved stereo frames in the output format
+        std::vector<int16_t> pcm;
+
+        [[nodiscard]] int64_t frames() const {
+            return static_cast<int64_t>(pcm.size() / 2);
+        }
+    };
+
+    /**
+     * @brief Read a clip stored by write_clip_file
+     *
+     * @param path Song the clip belongs to, used when playback leaves the clip
+     * @return nullptr if the file is missing, corrupted or was stored for another output rate
+     */
+    std::shared_ptr<PcmClip> read_clip_file(const std::string &file, const std::string &path, int sample_rate);
+
+    /**
+     * @brief Check the header of a stored clip without reading its data
+     *
+     * @return false if the file is missing, corrupted or was stored for another output rate
+     */
+    bool clip_file_valid(const std::string &file, int sample_rate);
+
+    /**
+     * @brief Store a clip as raw PCM, loaded back without decoding or resampling
+     */
+    bool write_clip_file(const std::string &file, const PcmClip &clip, int sample_rate);
+
+    /**
+     * @brief Open a music file for decoding on the current thread
+     *
+     * MP3 files are streamed, with a frame index built on open so seeks are exact and do not decode from the start.
+     * Other formats are decoded whole by SDL_mixer.
+     *
+     * @return nullptr if the file cannot be decoded
+     */
+    std::unique_ptr<MusicSource> open_music_source(const std::string &path, int sample_rate);
+
+    /**
+     * @brief Music player decoding on its own thread
+     *
+     * The decoder thread fills a single producer single consumer ring buffer ahead of playback, the audio thread drains
+     * it in the music hook. Opening and seeking only post a command, the main thread never waits for the decoder.
+     * Commands are coalesced, so scrolling quickly through a list only opens the last file.
+     *
+     * An open can crossfade from the music being replaced: the part of it already in the ring is kept and faded out
+     * while the new music fades in, so the old music continues from exactly where it was heard.
+     *
+     * Playback rates other than 1 are time-stretched on the audio thread as the ring is drained, so a rate change
+     * is heard on the next buffer and the decoder and its ring stay at the original speed.
+     */
+    class MusicStream {
+    public:
+        explicit MusicStream(uint32_t finished_event);
+        ~MusicStream();
+
+        void start(int sample_rate);
+        void shutdown();
+
+        /**
+         * @brief Open a song, main thread
+         *
+         * @param clip Starts the music from memory, the file is only opened when playback leaves the clip
+         * @param clip_file Clip stored on disk, read by the decoder instead of decoding the song when it is valid
+         */
+        void open(const std::string &path, int64_t frame = 0, std::shared_ptr<const PcmClip> clip = nullptr,
+                  bool crossfade = false, const std::string &clip_file = "");
+        void seek(int64_t frame);
+        void close();
+        void set_paused(bool state);
+        [[nodiscard]] bool paused() const;
+        // playback rate in percent, the pitch is kept
+        void set_rate(int percent);
+        [[nodiscard]] int rate() const;
+        // serial of the last open, seek or close, and the frame it moves the music to
+        [[nodiscard]] uint32_t requested_serial() const;
+        [[nodiscard]] int64_t requested_frame() const;
+        // the decoder could not open the music of the last open, it plays silence until the next one
+        [[nodiscard]] bool open_failed() const;
+
+        // audio thread, adds the next frames to the output
+        void mix(Uint8 *stream, int length, int volume);
+        // last command the audio thread has caught up with, and the music frame after the last mixed buffer
+        [[nodiscard]] uint32_t applied_serial() const;
+        [[nodiscard]] int64_t position() const;
+        // false while paused, closed or waiting for the decoder
+        [[nodiscard]] bool running() const;
+
+        // any thread, -1 until the decoder has opened the file
+        [[nodiscard]] int64_t length() const;
+
+    private:
+        struct Command {
+            bool open = false;
+            bool close = false;
+            bool crossfade = false;
+            std::string path;
+            std::shared_ptr<const PcmClip> clip;
+            std::string clip_file;
+            int64_t frame = 0;
+            uint32_t serial = 0;
+        };
+
+        const uint32_t finished_event;
+        int sample_rate = 0;
+        int64_t crossfade_frames = 0;
+        std::thread decoder;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::optional<Command> pending;
+        // written by the main thread only
+        uint32_t serial = 0;
+        int64_t target_frame = 0;
+        uint32_t open_serial = 0;
+        // serial of the last open the decoder failed, a coalesced seek may have raised it past open_serial
+        std::atomic_uint32_t failed_serial = 0;
+        std::atomic_uint32_t serial_published = 0;
+        std::atomic_bool paused_flag = false;
+        std::atomic_int rate_percent = 100;
+
+        // ring of interleaved stereo frames, positions only grow and wrap by mask
+        std::vector<int16_t> ring;
+        std::atomic_uint64_t write_pos = 0;
+        // oldest frame the audio thread still needs, the decoder never writes over it
+        std::atomic_uint64_t read_pos = 0;
+        // ring position where the music ends, set by the decoder at the end of the source
+        std::atomic_uint64_t end_pos = UINT64_MAX;
+        std::atomic_int64_t source_length = -1;
+
+        // last flush published by the decoder: data before flush_pos is stale, flush_pos holds music frame flush_frame,
+        // a negative frame means nothing is playing. Guarded by a sequence lock, odd while being written
+        std::atomic_uint32_t flush_sequence = 0;
+        std::atomic_uint64_t flush_pos = 0;
+        std::atomic_int64_t flush_frame = -1;
+        std::atomic_uint32_t flush_serial = 0;
+        std::atomic_bool flush_crossfade = false;
+
+        // audio thread state
+        uint32_t consumer_serial = 0;
+        uint64_t main_read = 0;
+        // tail of the replaced music being faded out, and how far the new music has faded in
+        uint64_t fade_read = 0;
+        int64_t fade_left = 0, fade_total = 0, fade_in = 0;
+        bool active = false;
+        bool finish_signalled = false;
+        // once engaged the stretcher runs until the next flush, even at rate 1, its buffered input is already read.
+        // Frames mixed since the rate last changed, and the music frame at that point
+        TimeStretcher stretcher;
+        std::vector<int16_t> stretch_buffer;
+        bool stretching = false;
+        int stretch_rate = 100;
+        int64_t stretch_base = 0;
+        uint64_t stretch_served = 0;
+        std::atomic_uint32_t applied = 0;
+        std::atomic_int64_t played_frames = 0;
+        std::atomic_bool mixing = false;
+
+        void post(Command &&command);
+        void run();
+        void apply(const Command &command, std::unique_ptr<MusicSource> &source, bool &exhausted);
+        void publish_flush(int64_t frame, uint32_t command_serial, bool crossfade = false);
+        // audio thread, fills the buffer with stretched music from the ring
+        uint64_t stretch(int16_t *out, uint64_t frames, uint64_t written);
+    };
+} // namespace anisette::core::audio
@@ -0,0 +1,240 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "pcm_cache.h"
+#include "hash.h"
+#include "logging.h"
+#include <algorithm>
+#include <filesystem>
+
+const auto logger = anisette::logging::get("pcm");
+
+namespace anisette::core::audio
+{
+    PcmCache::PcmCache(const char *name, const int clip_ms, const char *store_dir)
+        : name(name), clip_ms(clip_ms), store_dir(store_dir) {}
+
+    PcmCache::~PcmCache() {
+        shutdown();
+    }
+
+    void PcmCache::start(const int sample_rate, const size_t budget_bytes, const size_t store_budget_bytes) {
+        this->budget_bytes = budget_bytes;
+        this->store_budget_bytes = store_dir != nullptr ? store_budget_bytes : 0;
+        if (budget_bytes == 0) return;
+        this->sample_rate = sample_rate;
+        worker = std::thread([this]() { run(); });
+    }
+
+    void PcmCache::shutdown() {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    uint64_t PcmCache::key_of(const std::string &path, const uint64_t content_id, const int preview_ms) {
+        // difficulties of a set share the music but not always the preview point
+        const uint64_t music = content_id != 0 ? content_id : utils::fnv1a64(path);
+        return utils::fnv1a64(&preview_ms, sizeof(preview_ms), music);
+    }
+
+    void PcmCache::prefetch(std::vector<PreviewRequest> &&requests) {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard lock(mutex);
+            queue = std::move(requests);
+        }
+        wake.notify_one();
+    }
+
+    void PcmCache::extract(std::vector<PreviewRequest> &&requests) {
+        if (!worker.joinable() || store_dir == nullptr) return;
+        {
+            std::lock_guard lock(mutex);
+            backlog = std::move(requests);
+            backlog_next = 0;
+            prune_pending = true;
+        }
+        wake.notify_one();
+    }
+
+    std::string PcmCache::stored_path(const uint64_t content_id, const int preview_ms) const {
+        // a path hash does not follow the file when it is replaced, only content ids are stored
+        if (store_dir == nullptr || content_id == 0) return {};
+        char file[32];
+        snprintf(file, sizeof(file), "%016llx.pcm",
+                 static_cast<unsigned long long>(utils::fnv1a64(&preview_ms, sizeof(preview_ms), content_id)));
+        return std::string(store_dir) + '/' + file;
+    }
+
+    std::shared_ptr<const PcmClip> PcmCache::find(const std::string &path, const uint64_t content_id,
+                                                          const int preview_ms) {
+        std::lock_guard lock(mutex);
+        const auto it = lookup.find(key_of(path, content_id, preview_ms));
+        if (it == lookup.end()) return nullptr;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+
+    std::shared_ptr<PcmClip> PcmCache::decode(const PreviewRequest &request) {
+        const auto file = stored_path(request.content_id, request.preview_ms);
+        if (!file.empty()) {
+            if (auto stored = read_clip_file(file, request.path, sample_rate)) return stored;
+        }
+        const auto source = open_music_source(request.path, sample_rate);
+        if (source == nullptr) return nullptr;
+        auto clip = std::make_shared<PcmClip>();
+        clip->path = request.path;
+        if (clip_ms == 0) {
+            clip->complete = true;
+            if (source->length() > 0) clip->pcm.reserve(static_cast<size_t>(source->length()) * 2);
+        } else {
+            clip->start_frame = static_cast<int64_t>(std::max(request.preview_ms, 0)) * sample_rate / 1000;
+            if (source->length() > 0 && clip->start_frame >= source->length()) clip->start_frame = 0;
+            if (!source->seek(clip->start_frame)) return nullptr;
+        }
+        // a whole song grows chunk by chunk when its length is unknown
+        const size_t frames = clip_ms == 0 ? SIZE_MAX : static_cast<size_t>(clip_ms) * sample_rate / 1000;
+        size_t done = 0;
+        while (done < frames) {
+            const size_t chunk = std::min<size_t>(frames - done, sample_rate);
+            clip->pcm.resize((done + chunk) * 2);
+            const size_t got = source->read(clip->pcm.data() + done * 2, chunk);
+            done += got;
+            if (got == 0) break;
+            if (clip->pcm.size() * sizeof(int16_t) > budget_bytes) {
+                logger->debug("{} does not fit in the {} cache", request.path, name);
+                return nullptr;
+            }
+        }
+        clip->pcm.resize(done * 2);
+        clip->pcm.shrink_to_fit();
+        const size_t bytes = clip->pcm.size() * sizeof(int16_t);
+        if (!file.empty() && stored_bytes + bytes <= store_budget_bytes && write_clip_file(file, *clip, sample_rate)) {
+            stored_bytes += bytes;
+        }
+        return clip;
+    }
+
+    void PcmCache::extract_next(std::unique_lock<std::mutex> &lock) {
+        const PreviewRequest request = backlog[backlog_next++];
+        const uint64_t key = key_of(request.path, request.content_id, request.preview_ms);
+        const auto file = stored_path(request.content_id, request.preview_ms);
+        if (file.empty() || lookup.contains(key) || failed.contains(key)) return;
+        lock.unlock();
+        // a clip stored for another output rate or cut short is extracted again
+        const bool stored = clip_file_valid(file, sample_rate);
+        const size_t clip_bytes = static_cast<size_t>(clip_ms) * sample_rate / 1000 * 2 * sizeof(int16_t);
+        if (!stored && stored_bytes + clip_bytes > store_budget_bytes) {
+            lock.lock();
+            logger->info("The {} store is full at {} MiB, {} clips left unextracted", name, stored_bytes >> 20,
+                         backlog.size() - backlog_next + 1);
+            backlog_next = backlog.size();
+            return;
+        }
+        const bool decoded = stored || decode(request) != nullptr;
+        lock.lock();
+        if (!decoded) {
+            logger->warn("Failed to extract the {} clip of {}", name, request.path);
+            failed.insert(key);
+        } else if (!stored) {
+            logger->debug("Stored the {} clip of {}", name, request.path);
+        }
+    }
+
+    void PcmCache::prune_store(const std::unordered_set<std::string> &keep) {
+        struct StoredFile {
+            std::filesystem::file_time_type time;
+            uintmax_t size;
+            std::filesystem::path path;
+        };
+        std::vector<StoredFile> files;
+        size_t removed = 0;
+        stored_bytes = 0;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(store_dir, ec)) {
+            const auto &path = entry.path();
+            // clips of songs removed or replaced, of another output rate, and interrupted writes
+            if (!keep.contains(path.filename().string()) || !clip_file_valid(path.string(), sample_rate)) {
+                if (std::filesystem::remove(path, ec)) removed++;
+                continue;
+            }
+            const auto size = entry.file_size(ec);
+            if (ec) continue;
+            files.push_back({entry.last_write_time(ec), size, path});
+            stored_bytes += size;
+        }
+        // still over the budget, e.g. after it was lowered: the clips extracted first go first
+        if (stored_bytes > store_budget_bytes) {
+            std::ranges::sort(files, {}, &StoredFile::time);
+            for (const auto &file : files) {
+                if (stored_bytes <= store_budget_bytes) break;
+                if (!std::filesystem::remove(file.path, ec)) continue;
+                stored_bytes -= file.size;
+                removed++;
+            }
+        }
+        logger->debug("Pruned {} clips from the {} store, {} MiB left", removed, name, stored_bytes >> 20);
+    }
+
+    void PcmCache::run() {
+        std::unique_lock lock(mutex);
+        while (!stopping) {
+            // requests come by priority, skip what is already there
+            const auto next = std::ranges::find_if(queue, [this](const PreviewRequest &request) {
+                const uint64_t key = key_of(request.path, request.content_id, request.preview_ms);
+                return !lookup.contains(key) && !failed.contains(key);
+            });
+            if (next == queue.end()) {
+                queue.clear();
+                if (prune_pending) {
+                    prune_pending = false;
+                    std::unordered_set<std::string> keep;
+                    for (const auto &request : backlog) {
+                        const auto file = stored_path(request.content_id, request.preview_ms);
+                        if (!file.empty()) keep.insert(std::filesystem::path(file).filename().string());
+                    }
+                    lock.unlock();
+                    prune_store(keep);
+                    lock.lock();
+                    continue;
+                }
+                if (backlog_next < backlog.size()) {
+                    extract_next(lock);
+                    continue;
+                }
+                wake.wait(lock, [this]() { return stopping || !queue.empty() || backlog_next < backlog.size(); });
+                continue;
+            }
+            const PreviewRequest request = *next;
+            queue.erase(queue.begin(), next + 1);
+            const uint64_t key = key_of(request.path, request.content_id, request.preview_ms);
+            lock.unlock();
+
+            const uint64_t start = SDL_GetPerformanceCounter();
+            const auto clip = decode(request);
+            const auto elapsed_ms = (SDL_GetPerformanceCounter() - start) * 1000 / system_freq;
+
+            lock.lock();
+            if (clip == nullptr) {
+                logger->warn("Failed to decode {} for the {} cache", request.path, name);
+                failed.insert(key);
+                continue;
+            }
+            logger->debug("Decoded {} for the {} cache in {}ms", request.path, name, elapsed_ms);
+            used_bytes += clip->pcm.size() * sizeof(int16_t);
+            entries.emplace_front(key, clip);
+            lookup[key] = entries.begin();
+            // a clip being played is kept alive by the player, evicting it only drops the cache reference
+            while (used_bytes > budget_bytes && entries.size() > 1) {
+                used_bytes -= entries.back().second->pcm.size() * sizeof(int16_t);
+                lookup.erase(entries.back().first);
+                entries.pop_back();
+            }
+        }
+    }
+} // namespace anisette::core::audio
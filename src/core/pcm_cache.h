@@ -0,0 +1,102 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include "core.h"
+#include "music_stream.h"
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace anisette::core::audio
+{
+    /**
+     * @brief Memory-budgeted cache of decoded songs or parts of them, filled by a background thread
+     *
+     * Clips are kept in least recently used order and evicted once their total size exceeds the budget.
+     *
+     * With a store directory, clips of songs with a content id are also kept on disk, named after the content id and
+     * position. Decoding a request reads the stored clip first, and a backlog of extractions fills the store while
+     * no prefetch is waiting, so most clips are never decoded while browsing. The store has its own budget: a new
+     * backlog first prunes the clips of songs no longer in it, and extraction stops once the store is full.
+     */
+    class PcmCache {
+    public:
+        /**
+         * @param clip_ms Length decoded from the requested position, 0 to decode the whole song from the start
+         * @param store_dir Directory of the clips stored on disk, null to keep them in memory only
+         */
+        PcmCache(const char *name, int clip_ms, const char *store_dir = nullptr);
+        ~PcmCache();
+
+        /**
+         * @param budget_bytes Memory budget, 0 disables the cache
+         * @param store_budget_bytes Disk budget of the store directory, 0 stores nothing
+         */
+        void start(int sample_rate, size_t budget_bytes, size_t store_budget_bytes = 0);
+        void shutdown();
+
+        /**
+         * @brief Replace the queued requests, the first ones are decoded first
+         */
+        void prefetch(std::vector<PreviewRequest> &&requests);
+
+        /**
+         * @brief Replace the backlog of clips to store on disk, worked through when no prefetch is waiting
+         *
+         * Stored clips not in the backlog are deleted, it should hold every song that keeps its clip.
+         */
+        void extract(std::vector<PreviewRequest> &&requests);
+
+        /**
+         * @brief Path of the stored clip of a request, whether it exists or not
+         *
+         * @return Empty without a store directory or a content id
+         */
+        [[nodiscard]] std::string stored_path(uint64_t content_id, int preview_ms) const;
+
+        /**
+         * @brief Get a decoded clip and mark it as recently used
+         *
+         * @return nullptr if it is not decoded yet
+         */
+        [[nodiscard]] std::shared_ptr<const PcmClip> find(const std::string &path, uint64_t content_id,
+                                                              int preview_ms);
+
+    private:
+        using Entry = std::pair<uint64_t, std::shared_ptr<const PcmClip>>;
+
+        const char *name;
+        const int clip_ms;
+        const char *store_dir;
+        size_t budget_bytes = 0;
+        int sample_rate = 0;
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stopping = false;
+        std::vector<PreviewRequest> queue;
+        std::vector<PreviewRequest> backlog;
+        size_t backlog_next = 0;
+        bool prune_pending = false;
+        // worker thread only: the store budget and the size of the clips in the store
+        size_t store_budget_bytes = 0;
+        size_t stored_bytes = 0;
+
+        // most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+        // files that failed to decode are not tried again
+        std::unordered_set<uint64_t> failed;
+        size_t used_bytes = 0;
+
+        static uint64_t key_of(const std::string &path, uint64_t content_id, int preview_ms);
+        void run();
+        // stores the clip on disk with a store directory, does not touch the memory cache
+        void extract_next(std::unique_lock<std::mutex> &lock);
+        // deletes stored clips not in keep or no longer valid, then the oldest ones while over the budget
+        void prune_store(const std::unordered_set<std::string> &keep);
+        // stores the decoded clip too while the store has room
+        std::shared_ptr<PcmClip> decode(const PreviewRequest &request);
+    };
+} // namespace anisette::core::audio
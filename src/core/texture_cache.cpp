@@ -0,0 +1,89 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "texture_cache.h"
+#include "core.h"
+#include "hash.h"
+#include "logging.h"
+#include <SDL2/SDL_image.h>
+#include <list>
+#include <unordered_map>
+
+const auto logger = anisette::logging::get("texture_cache");
+namespace anisette::core::video
+{
+    struct CacheEntry {
+        uint64_t key;
+        std::shared_ptr<const CachedTexture> texture;
+    };
+
+    // most recently used first
+    static std::list<CacheEntry> entries;
+    static std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> index;
+    static TextureCacheStats stats;
+
+    CachedTexture::CachedTexture(SDL_Texture *texture, const int w, const int h)
+        : texture(texture), w(w), h(h), bytes(static_cast<size_t>(w) * h * 4) {}
+
+    CachedTexture::~CachedTexture() {
+        SDL_DestroyTexture(texture);
+    }
+
+    // evict from the least recently used end, skipping textures a handle still refers to
+    static void evict() {
+        for (auto it = entries.end(); it != entries.begin() && stats.bytes > stats.budget_bytes;) {
+            --it;
+            if (it->texture.use_count() > 1) continue;
+            stats.bytes -= it->texture->bytes;
+            stats.evictions++;
+            index.erase(it->key);
+            it = entries.erase(it);
+        }
+        stats.textures = entries.size();
+    }
+
+    TextureHandle load_texture(const std::string &path, const uint64_t content_id) {
+        if (path.empty()) return nullptr;
+        // path keys are hashed with a different seed so they do not collide with content ids
+        const uint64_t key = content_id != 0 ? content_id : utils::fnv1a64(path, utils::fnv1a64("path"));
+        if (const auto it = index.find(key); it != index.end()) {
+            stats.hits++;
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->texture;
+        }
+        stats.misses++;
+        SDL_Texture *texture = IMG_LoadTexture(renderer, path.c_str());
+        if (!texture) {
+            logger->warn("Failed to load image {}: {}", path, SDL_GetError());
+            return nullptr;
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        int w, h;
+        SDL_QueryTexture(texture, nullptr, nullptr, &w, &h);
+        auto handle = std::make_shared<const CachedTexture>(texture, w, h);
+        entries.push_front({key, handle});
+        index[key] = entries.begin();
+        stats.bytes += handle->bytes;
+        // the new texture is referenced by the handle returned, it is never the one evicted
+        evict();
+        return handle;
+    }
+
+    void set_texture_cache_budget(const size_t budget_bytes) {
+        stats.budget_bytes = budget_bytes;
+        evict();
+    }
+
+    TextureCacheStats texture_cache_stats() {
+        return stats;
+    }
+
+    void clear_texture_cache() {
+        logger->info("Texture cache: {} hits, {} misses, {} evictions, {} textures in {} MiB at exit", stats.hits,
+                     stats.misses, stats.evictions, stats.textures, stats.bytes >> 20);
+        index.clear();
+        entries.clear();
+        stats.bytes = 0;
+        stats.textures = 0;
+    }
+} // namespace anisette::core::video
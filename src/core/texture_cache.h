@@ -0,0 +1,60 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <SDL2/SDL_render.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace anisette::core::video
+{
+    /**
+     * @brief A texture owned by the cache, or by its handles once evicted
+     */
+    struct CachedTexture {
+        SDL_Texture *texture = nullptr;
+        int w = 0, h = 0;
+        // estimated video memory, 4 bytes per pixel
+        size_t bytes = 0;
+
+        CachedTexture(SDL_Texture *texture, int w, int h);
+        ~CachedTexture();
+        CachedTexture(const CachedTexture &) = delete;
+        CachedTexture &operator=(const CachedTexture &) = delete;
+    };
+
+    // the texture is destroyed once the cache and every handle have let go of it
+    using TextureHandle = std::shared_ptr<const CachedTexture>;
+
+    struct TextureCacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t textures = 0;
+        size_t bytes = 0;
+        size_t budget_bytes = 0;
+    };
+
+    /**
+     * @brief Texture of an image file, decoded once and shared by everything showing it
+     *
+     * Textures are kept in least recently used order and evicted once their total size exceeds the budget. Textures
+     * still referenced by a handle count towards it but are never evicted, they go on a later load once released.
+     * Main thread only.
+     *
+     * @param content_id Content id of the file, the key instead of the path when set, so copies of an image under
+     *                   different paths share one texture
+     * @return nullptr if the image cannot be loaded, failures are not cached
+     */
+    TextureHandle load_texture(const std::string &path, uint64_t content_id = 0);
+
+    /**
+     * @brief Set the video memory budget, evicting right away if the cache is over it
+     */
+    void set_texture_cache_budget(size_t budget_bytes);
+    [[nodiscard]] TextureCacheStats texture_cache_stats();
+    // drop every cached texture, before the renderer is destroyed
+    void clear_texture_cache();
+} // namespace anisette::core::video
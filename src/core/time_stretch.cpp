@@ -0,0 +1,212 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "time_stretch.h"
+#include <SDL2/SDL_timer.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STRETCH_SSE2
+#endif
+
+// long enough to hold a beat of most music, short enough not to smear its attacks
+#define SEQUENCE_MS 40
+#define OVERLAP_MS 8
+#define SEEK_MS 15
+// coarse seek step in frames, the best candidate is then refined within one step around it
+#define MIN_SEEK_STEP 2
+#define MAX_SEEK_STEP 64
+// share of the time a sequence plays for that its processing may take
+#define STRETCH_BUDGET_PERCENT 25
+
+namespace anisette::core::audio
+{
+    // lengths are multiples of 4 frames, the vector loops handle 4 frames at a time
+    static size_t frames_of(const int sample_rate, const int ms) {
+        return std::max<size_t>((static_cast<size_t>(sample_rate) * ms / 1000) & ~static_cast<size_t>(3), 4);
+    }
+
+    // sum of a * b and of b * b, count is a multiple of 4
+    static void correlate(const float *a, const float *b, const size_t count, float &dot, float &energy) {
+#ifdef STRETCH_SSE2
+        __m128 d = _mm_setzero_ps(), e = _mm_setzero_ps();
+        for (size_t i = 0; i < count; i += 4) {
+            const __m128 x = _mm_loadu_ps(a + i);
+            const __m128 y = _mm_loadu_ps(b + i);
+            d = _mm_add_ps(d, _mm_mul_ps(x, y));
+            e = _mm_add_ps(e, _mm_mul_ps(y, y));
+        }
+        alignas(16) float lanes[8];
+        _mm_store_ps(lanes, d);
+        _mm_store_ps(lanes + 4, e);
+        dot = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        energy = lanes[4] + lanes[5] + lanes[6] + lanes[7];
+#else
+        dot = energy = 0;
+        for (size_t i = 0; i < count; i++) {
+            dot += a[i] * b[i];
+            energy += b[i] * b[i];
+        }
+#endif
+    }
+
+    // convert to 16 bits with saturation, count is a multiple of 8
+    static void to_int16(int16_t *out, const float *in, const size_t count) {
+#ifdef STRETCH_SSE2
+        for (size_t i = 0; i < count; i += 8) {
+            const __m128i low = _mm_cvtps_epi32(_mm_loadu_ps(in + i));
+            const __m128i high = _mm_cvtps_epi32(_mm_loadu_ps(in + i + 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(low, high));
+        }
+#else
+        for (size_t i = 0; i < count; i++) {
+            out[i] = static_cast<int16_t>(std::clamp(std::lrint(in[i]), -32768L, 32767L));
+        }
+#endif
+    }
+
+    // linear crossfade of two stereo runs into 16 bits, frames is a multiple of 4
+    static void crossfade(int16_t *out, const float *from, const float *to, const size_t frames) {
+        const float step = 1.0f / static_cast<float>(frames);
+#ifdef STRETCH_SSE2
+        // a vector holds two stereo frames, both channels of a frame share the gain
+        __m128 gain = _mm_setr_ps(0, 0, step, step);
+        const __m128 advance = _mm_set1_ps(2 * step);
+        for (size_t i = 0; i < frames * 2; i += 8) {
+            __m128 a = _mm_loadu_ps(from + i);
+            __m128 low = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(to + i), a), gain));
+            gain = _mm_add_ps(gain, advance);
+            a = _mm_loadu_ps(from + i + 4);
+            __m128 high = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(to + i + 4), a), gain));
+            gain = _mm_add_ps(gain, advance);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                             _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high)));
+        }
+#else
+        for (size_t i = 0; i < frames; i++) {
+            const float gain = step * static_cast<float>(i);
+            for (size_t c = 0; c < 2; c++) {
+                const float value = from[i * 2 + c] + (to[i * 2 + c] - from[i * 2 + c]) * gain;
+                out[i * 2 + c] = static_cast<int16_t>(std::clamp(std::lrint(value), -32768L, 32767L));
+            }
+        }
+#endif
+    }
+
+    void TimeStretcher::start(const int sample_rate) {
+        this->sample_rate = sample_rate;
+        sequence_frames = frames_of(sample_rate, SEQUENCE_MS);
+        overlap_frames = frames_of(sample_rate, OVERLAP_MS);
+        seek_frames = static_cast<size_t>(sample_rate) * SEEK_MS / 1000;
+        seek_step = MIN_SEEK_STEP * 2;
+        input.assign((seek_frames + sequence_frames) * 2, 0);
+        tail.assign(overlap_frames * 2, 0);
+        produced.assign((sequence_frames - overlap_frames) * 2, 0);
+        reset();
+    }
+
+    void TimeStretcher::reset() {
+        input_frames = 0;
+        skip_pending = 0;
+        skip_fraction = 0;
+        std::ranges::fill(tail, 0.0f);
+        produced_pos = produced_count = 0;
+    }
+
+    void TimeStretcher::set_rate(const double rate) {
+        this->rate = rate;
+    }
+
+    size_t TimeStretcher::input_needed() const {
+        const size_t required = seek_frames + sequence_frames;
+        return skip_pending + (input_frames < required ? required - input_frames : 0);
+    }
+
+    void TimeStretcher::feed(const int16_t *frames, size_t count) {
+        const size_t skipped = std::min(count, skip_pending);
+        frames += skipped * 2;
+        count -= skipped;
+        skip_pending -= skipped;
+        count = std::min(count, seek_frames + sequence_frames - input_frames);
+        float *dst = input.data() + input_frames * 2;
+        for (size_t i = 0; i < count * 2; i++) dst[i] = frames[i];
+        input_frames += count;
+    }
+
+    size_t TimeStretcher::output(int16_t *out, const size_t frames) {
+        size_t done = 0;
+        while (done < frames) {
+            if (produced_pos == produced_count) {
+                if (input_frames < seek_frames + sequence_frames) break;
+                process_sequence();
+            }
+            const size_t count = std::min(frames - done, produced_count - produced_pos);
+            std::memcpy(out + done * 2, produced.data() + produced_pos * 2, count * 2 * sizeof(int16_t));
+            produced_pos += count;
+            done += count;
+        }
+        return done;
+    }
+
+    size_t TimeStretcher::best_offset() const {
+        const size_t count = overlap_frames * 2;
+        float dot, tail_energy;
+        correlate(tail.data(), tail.data(), count, dot, tail_energy);
+        const float center = static_cast<float>(seek_frames) / 2;
+        const auto score = [&](const size_t offset) {
+            float energy;
+            correlate(tail.data(), input.data() + offset * 2, count, dot, energy);
+            // slightly favour the middle of the window, where the sequence would come from at the exact rate
+            const float distance = (static_cast<float>(offset) - center) / center;
+            const float similarity = dot / std::sqrt(tail_energy * energy + 1.0f);
+            return (similarity + 0.1f) * (1.0f - 0.25f * distance * distance);
+        };
+        size_t best = seek_frames / 2;
+        float best_score = score(best);
+        for (size_t offset = 0; offset <= seek_frames; offset += seek_step) {
+            if (const float value = score(offset); value > best_score) {
+                best_score = value;
+                best = offset;
+            }
+        }
+        const size_t coarse = best;
+        const size_t end = std::min(coarse + seek_step / 2, seek_frames);
+        for (size_t offset = coarse > seek_step / 2 ? coarse - seek_step / 2 : 0; offset <= end; offset++) {
+            if (const float value = score(offset); value > best_score) {
+                best_score = value;
+                best = offset;
+            }
+        }
+        return best;
+    }
+
+    void TimeStretcher::process_sequence() {
+        const uint64_t start = SDL_GetPerformanceCounter();
+        const float *sequence = input.data() + best_offset() * 2;
+        crossfade(produced.data(), tail.data(), sequence, overlap_frames);
+        to_int16(produced.data() + overlap_frames * 2, sequence + overlap_frames * 2,
+                 (sequence_frames - overlap_frames * 2) * 2);
+        std::copy_n(sequence + (sequence_frames - overlap_frames) * 2, overlap_frames * 2, tail.data());
+        produced_pos = 0;
+        produced_count = sequence_frames - overlap_frames;
+
+        // the next sequence starts the output length times the rate later, fractions carry over
+        skip_fraction += rate * static_cast<double>(produced_count);
+        const auto skip = static_cast<size_t>(skip_fraction);
+        skip_fraction -= static_cast<double>(skip);
+        const size_t dropped = std::min(skip, input_frames);
+        std::memmove(input.data(), input.data() + dropped * 2, (input_frames - dropped) * 2 * sizeof(float));
+        input_frames -= dropped;
+        skip_pending = skip - dropped;
+
+        // a coarser seek costs about half as much, refine again only when well below the budget
+        const uint64_t elapsed = SDL_GetPerformanceCounter() - start;
+        const uint64_t budget = static_cast<uint64_t>(produced_count) * SDL_GetPerformanceFrequency() / sample_rate
+            * STRETCH_BUDGET_PERCENT / 100;
+        if (elapsed > budget && seek_step < MAX_SEEK_STEP) seek_step *= 2;
+        else if (elapsed * 4 < budget && seek_step > MIN_SEEK_STEP) seek_step /= 2;
+    }
+} // namespace anisette::core::audio
@@ -0,0 +1,72 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace anisette::core::audio
+{
+    /**
+     * @brief Pitch-preserving time stretching of 16-bit stereo music, WSOLA
+     *
+     * The output is cut into overlapping sequences. Each one is taken from the input at the position the rate asks
+     * for, moved within a short seek window to where it lines up best with the end of the previous sequence, and
+     * crossfaded with it. Correlation, crossfade and conversion are vectorized with SSE2 where available.
+     *
+     * Runs on the audio thread: buffers are allocated by start() only, and every sequence has a CPU budget of a share
+     * of the time it plays for. Over budget the seek gets coarser, so a slow machine trades a little quality instead of
+     * dropping out, and no device buffer spends more than that share on stretching.
+     */
+    class TimeStretcher {
+    public:
+        void start(int sample_rate);
+        // drop the buffered input and output, the next sequence starts from silence
+        void reset();
+        // input frames played per output frame, takes effect on the next sequence
+        void set_rate(double rate);
+
+        /**
+         * @brief Input frames missing before the next sequence can be produced
+         */
+        [[nodiscard]] size_t input_needed() const;
+        void feed(const int16_t *frames, size_t count);
+
+        /**
+         * @brief Produce stretched frames while the buffered input allows it
+         *
+         * @return Number of frames written, fewer than asked when more input is needed
+         */
+        size_t output(int16_t *out, size_t frames);
+
+        // input frames between the nominal position and the center of the seek window
+        [[nodiscard]] int64_t latency() const {
+            return static_cast<int64_t>(seek_frames / 2);
+        }
+
+    private:
+        int sample_rate = 0;
+        double rate = 1.0;
+        // in frames: length of a sequence, of its crossfade with the previous one, and of the seek window
+        size_t sequence_frames = 0;
+        size_t overlap_frames = 0;
+        size_t seek_frames = 0;
+        // distance between two candidates of the coarse seek
+        size_t seek_step = 0;
+
+        // interleaved stereo, the input from the nominal position of the next sequence
+        std::vector<float> input;
+        size_t input_frames = 0;
+        // input to drop as it arrives, when a skip was longer than the buffered input
+        size_t skip_pending = 0;
+        double skip_fraction = 0;
+        // end of the previous sequence, crossfaded into the next one
+        std::vector<float> tail;
+        std::vector<int16_t> produced;
+        size_t produced_pos = 0, produced_count = 0;
+
+        size_t best_offset() const;
+        void process_sequence();
+    };
+} // namespace anisette::core::audio
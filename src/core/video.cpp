@@ -4,6 +4,8 @@
 #include "core.h"
 #include "internal.h"
 #include "config.h"
+#include "glyph_atlas.h"
+#include "texture_cache.h"
 #include "logging.h"
 #include <SDL2/SDL_render.h>
 
@@ -66,10 +68,13 @@ namespace anisette::core::video
             logger->error("Failed to load font: {}", TTF_GetError());
             return false;
         }
+        set_texture_cache_budget(static_cast<size_t>(config::texture_cache_mb) << 20);
         return true;
     }
 
     void cleanup() {
+        GlyphAtlas::clear();
+        clear_texture_cache();
         TTF_CloseFont(primary_font);
         TTF_CloseFont(secondary_font);
         SDL_DestroyWindow(window);
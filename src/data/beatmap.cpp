@@ -3,10 +3,20 @@
 //
 #include "data.h"
 #include "logging.h"
-#include <fstream>
-#include <rapidjson/document.h>
-#include <rapidjson/istreamwrapper.h>
+#include "mapped_file.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <rapidjson/error/en.h>
+#include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
 
+// a note takes at least "[0,0]" in the file, bounds the storage reserved from the note counts
+#define MIN_NOTE_BYTES 5
 // these fields are used for data validation
 #define SCHEMA_VERSION 1
 #define SCHEMA_URL "https://raw.githubusercontent.com/im-yuuki/AnisetteProject/refs/heads/sdl2/scripts/beatmap.schema.json"
@@ -15,96 +25,394 @@ const auto logger = anisette::logging::get("beatmap");
 
 namespace anisette::data
 {
-    bool Beatmap::load(const std::string &filename, const std::string &dir) {
-        path = dir + '/' + filename;
-        for (auto &note : notes) {
-            note.clear();
+    /**
+     * @brief SAX handler that fills a beatmap straight from the token stream
+     *
+     * Notes are appended to a single flat array reserved from the note counts in the file, every channel remembers
+     * its slice of it. Any unexpected token stops the parser with a message pointing at the offending field.
+     * Without a note chart to fill, the parser stops as soon as every header field has been read.
+     */
+    class BeatmapReader final : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, BeatmapReader> {
+        enum Field : uint16_t {
+            F_SCHEMA = 1 << 0,
+            F_VERSION = 1 << 1,
+            F_ID = 1 << 2,
+            F_TITLE = 1 << 3,
+            F_ARTIST = 1 << 4,
+            F_THUMBNAIL = 1 << 5,
+            F_MUSIC = 1 << 6,
+            F_PREVIEW_POINT = 1 << 7,
+            F_DIFFICULTY = 1 << 8,
+            F_HP_DRAIN = 1 << 9,
+            F_NOTES = 1 << 10,
+            F_SINGLE_NOTE_COUNT = 1 << 11,
+            F_HOLD_NOTE_COUNT = 1 << 12,
+            F_ALL = (1 << 13) - 1,
+        };
+
+        enum State : uint8_t {
+            ROOT_START,     // expecting the root object
+            ROOT,           // inside the root object, expecting a key
+            ROOT_VALUE,     // expecting the value of the current root key
+            NOTES,          // inside the notes object, expecting a key
+            NOTES_VALUE,    // expecting the value of the current notes key
+            CHANNEL,        // inside a channel array, expecting a note
+            NOTE,           // inside a note, expecting start/end
+            DONE,
+        };
+
+        Beatmap &beatmap;
+        const std::string &dir;
+        NoteChart *chart;
+        size_t input_size;
+        bool header_complete = false;
+        State state = ROOT_START;
+        uint16_t seen = 0;
+        std::string key;
+        int channel = -1;
+        int note_field = 0;
+        int note_value[2] {};
+        int skip_depth = 0;
+
+        std::vector<Note> flat;
+        size_t channel_begin[6] {};
+        size_t channel_size[6] {};
+        bool channel_seen[6] {};
+
+        bool fail(const std::string &message) {
+            error = message;
+            return false;
+        }
+
+        [[nodiscard]] std::string where() const {
+            if (state == NOTE || state == CHANNEL) {
+                return "notes.channel_" + std::to_string(channel) + "[" + std::to_string(channel_size[channel]) + "]";
+            }
+            if (state == NOTES_VALUE) return "notes." + key;
+            return key;
+        }
+
+        bool on_integer(const int64_t value) {
+            if (state == NOTE) {
+                if (note_field >= 2) return fail(where() + ": note must be a [start, end] pair");
+                if (value < INT_MIN || value > INT_MAX) return fail(where() + ": note time out of range");
+                note_value[note_field++] = static_cast<int>(value);
+                return true;
+            }
+            if (state == ROOT_VALUE) {
+                state = ROOT;
+                if (key == "version") return set(F_VERSION, value == SCHEMA_VERSION, "unsupported schema version");
+                if (key == "id") {
+                    if (value < 0 || value > UINT_MAX) return fail("id: out of range");
+                    beatmap.id = static_cast<unsigned>(value);
+                    return set(F_ID);
+                }
+                if (key == "preview_point") {
+                    if (value < 0 || value > UINT_MAX) return fail("preview_point: out of range");
+                    beatmap.preview_point = static_cast<unsigned>(value);
+                    return set(F_PREVIEW_POINT);
+                }
+                if (key == "difficulty") {
+                    if (value < 0 || value > 100) return fail("difficulty: must be in range 0-100");
+                    beatmap.difficulty = static_cast<uint8_t>(value);
+                    return set(F_DIFFICULTY);
+                }
+                if (key == "hp_drain") {
+                    if (value < 0 || value > 100) return fail("hp_drain: must be in range 0-100");
+                    beatmap.hp_drain = static_cast<uint8_t>(value);
+                    return set(F_HP_DRAIN);
+                }
+                return unexpected("integer");
+            }
+            if (state == NOTES_VALUE) {
+                state = NOTES;
+                if (value < 0 || value > INT_MAX) return fail(where() + ": out of range");
+                if (key == "single_note_count") {
+                    beatmap.single_note_count = static_cast<int>(value);
+                    if (!set(F_SINGLE_NOTE_COUNT)) return false;
+                } else if (key == "hold_note_count") {
+                    beatmap.hold_note_count = static_cast<int>(value);
+                    if (!set(F_HOLD_NOTE_COUNT)) return false;
+                } else {
+                    return unexpected("integer");
+                }
+                // both counts are written before the channels, reserve the whole note storage once, never more than
+                // the file can hold since the counts are not checked against the channels yet
+                if (chart && (seen & F_SINGLE_NOTE_COUNT) && (seen & F_HOLD_NOTE_COUNT)) {
+                    const size_t count = static_cast<size_t>(beatmap.single_note_count) + beatmap.hold_note_count;
+                    flat.reserve(flat.size() + std::min(count, input_size / MIN_NOTE_BYTES));
+                }
+                return true;
+            }
+            return unexpected("integer");
+        }
+
+        bool set(const uint16_t field, const bool valid = true, const char *message = nullptr) {
+            if (!valid) return fail(where() + ": " + message);
+            if (seen & field) return fail(where() + ": duplicated field");
+            seen |= field;
+            return true;
+        }
+
+        bool unexpected(const char *token) {
+            return fail((key.empty() ? std::string("root") : where()) + ": unexpected " + token);
+        }
+
+        // skip the value of an unknown key, including nested objects and arrays
+        bool skip_scalar() {
+            if (skip_depth > 0) return true;
+            if (state == ROOT_VALUE) state = ROOT;
+            else if (state == NOTES_VALUE) state = NOTES;
+            return true;
+        }
+
+    public:
+        std::string error;
+
+        BeatmapReader(Beatmap &beatmap, const std::string &dir, NoteChart *chart, const size_t input_size)
+            : beatmap(beatmap), dir(dir), chart(chart), input_size(input_size) {}
+
+        bool Null() { return skip_depth > 0 || is_unknown_key() ? skip_scalar() : unexpected("null"); }
+        bool Bool(bool) { return skip_depth > 0 || is_unknown_key() ? skip_scalar() : unexpected("boolean"); }
+        bool Int(const int i) { return skip_depth > 0 || is_unknown_key() ? skip_scalar() : on_integer(i); }
+        bool Uint(const unsigned u) { return skip_depth > 0 || is_unknown_key() ? skip_scalar() : on_integer(u); }
+        bool Int64(const int64_t i) { return skip_depth > 0 || is_unknown_key() ? skip_scalar() : on_integer(i); }
+        bool Uint64(const uint64_t u) {
+            if (skip_depth > 0 || is_unknown_key()) return skip_scalar();
+            return u > INT64_MAX ? fail(where() + ": out of range") : on_integer(static_cast<int64_t>(u));
+        }
+        bool Double(double) { return skip_depth > 0 || is_unknown_key() ? skip_scalar() : unexpected("number"); }
+
+        bool String(const char *str, const rapidjson::SizeType length, bool) {
+            if (skip_depth > 0 || is_unknown_key()) return skip_scalar();
+            if (state != ROOT_VALUE) return unexpected("string");
+            state = ROOT;
+            const std::string_view value(str, length);
+            if (key == "$schema") return set(F_SCHEMA, value == SCHEMA_URL, "unknown schema");
+            if (key == "title") {
+                beatmap.title.assign(value);
+                return set(F_TITLE);
+            }
+            if (key == "artist") {
+                beatmap.artist.assign(value);
+                return set(F_ARTIST);
+            }
+            if (key == "thumbnail") {
+                beatmap.thumbnail_path = dir + '/';
+                beatmap.thumbnail_path.append(value);
+                return set(F_THUMBNAIL);
+            }
+            if (key == "music") {
+                beatmap.music_path = dir + '/';
+                beatmap.music_path.append(value);
+                return set(F_MUSIC);
+            }
+            return unexpected("string");
+        }
+
+        bool Key(const char *str, const rapidjson::SizeType length, bool) {
+            if (skip_depth > 0) return true;
+            // header-only mode, nothing left to read
+            if (!chart && (seen & F_ALL) == F_ALL) {
+                header_complete = true;
+                return false;
+            }
+            key.assign(str, length);
+            if (state == ROOT) state = ROOT_VALUE;
+            else if (state == NOTES) state = NOTES_VALUE;
+            return true;
+        }
+
+        bool StartObject() {
+            if (skip_depth > 0 || is_unknown_key()) {
+                skip_depth++;
+                return true;
+            }
+            if (state == ROOT_START) {
+                state = ROOT;
+                return true;
+            }
+            if (state == ROOT_VALUE && key == "notes") {
+                state = NOTES;
+                return set(F_NOTES);
+            }
+            return unexpected("object");
         }
+
+        bool EndObject(rapidjson::SizeType) {
+            if (skip_depth > 0) return end_skip();
+            if (state == NOTES) {
+                state = ROOT;
+                return true;
+            }
+            if (state == ROOT) {
+                state = DONE;
+                return true;
+            }
+            return unexpected("end of object");
+        }
+
+        bool StartArray() {
+            if (skip_depth > 0 || is_unknown_key()) {
+                skip_depth++;
+                return true;
+            }
+            if (state == NOTES_VALUE) {
+                if (key.size() != 9 || key.substr(0, 8) != "channel_" || key[8] < '0' || key[8] > '5') {
+                    return unexpected("array");
+                }
+                if (!chart) {
+                    skip_depth++;
+                    return true;
+                }
+                channel = key[8] - '0';
+                if (channel_seen[channel]) return fail(where() + ": duplicated field");
+                channel_seen[channel] = true;
+                channel_begin[channel] = flat.size();
+                state = CHANNEL;
+                return true;
+            }
+            if (state == CHANNEL) {
+                note_field = 0;
+                state = NOTE;
+                return true;
+            }
+            return unexpected("array");
+        }
+
+        bool EndArray(rapidjson::SizeType) {
+            if (skip_depth > 0) return end_skip();
+            if (state == NOTE) {
+                if (note_field != 2) return fail(where() + ": note must be a [start, end] pair");
+                flat.push_back({note_value[0], note_value[1]});
+                channel_size[channel]++;
+                state = CHANNEL;
+                return true;
+            }
+            if (state == CHANNEL) {
+                state = NOTES;
+                return true;
+            }
+            return unexpected("end of array");
+        }
+
+        [[nodiscard]] bool is_unknown_key() const {
+            if (state == ROOT_VALUE) {
+                return key != "$schema" && key != "version" && key != "id" && key != "title" && key != "artist"
+                    && key != "thumbnail" && key != "music" && key != "preview_point" && key != "difficulty"
+                    && key != "hp_drain" && key != "notes";
+            }
+            if (state == NOTES_VALUE) {
+                return key != "single_note_count" && key != "hold_note_count" && key.substr(0, 8) != "channel_";
+            }
+            return false;
+        }
+
+        bool end_skip() {
+            if (--skip_depth == 0) skip_scalar();
+            return true;
+        }
+
+        /**
+         * @brief Check the required fields and move the parsed notes into the note chart
+         */
+        bool finish() {
+            if (state != DONE && !header_complete) return fail("unexpected end of document");
+            if ((seen & F_ALL) != F_ALL) {
+                static constexpr const char *names[] = {
+                    "$schema", "version", "id", "title", "artist", "thumbnail", "music", "preview_point",
+                    "difficulty", "hp_drain", "notes", "notes.single_note_count", "notes.hold_note_count"
+                };
+                for (int i = 0; i < 13; i++) {
+                    if (!(seen & 1 << i)) return fail(std::string("missing required field ") + names[i]);
+                }
+            }
+            if (!chart) return true;
+            for (int i = 0; i < 6; i++) {
+                if (!channel_seen[i]) return fail("missing required field notes.channel_" + std::to_string(i));
+            }
+            // lay the channels out one after another as columns, each slice sorted by start time
+            chart->start.reserve(flat.size());
+            chart->end.reserve(flat.size());
+            for (int i = 0; i < 6; i++) {
+                chart->channel_begin[i] = static_cast<uint32_t>(chart->start.size());
+                const auto begin = flat.begin() + static_cast<ptrdiff_t>(channel_begin[i]);
+                const auto end = begin + static_cast<ptrdiff_t>(channel_size[i]);
+                const auto by_start = [](const Note &a, const Note &b) { return a.start < b.start; };
+                if (!std::is_sorted(begin, end, by_start)) std::stable_sort(begin, end, by_start);
+                for (auto note = begin; note != end; ++note) {
+                    chart->start.push_back(note->start);
+                    chart->end.push_back(note->end);
+                }
+            }
+            chart->channel_begin[6] = static_cast<uint32_t>(chart->start.size());
+            chart->build_timeline();
+            return true;
+        }
+    };
+
+    void NoteChart::build_timeline() {
+        // (start, index) keys, the columns are in channel order so equal starts stay ordered by channel
+        std::vector<uint64_t> keys(start.size());
+        for (uint32_t i = 0; i < keys.size(); i++) {
+            keys[i] = static_cast<uint64_t>(static_cast<uint32_t>(start[i]) ^ 0x80000000u) << 32 | i;
+        }
+        std::ranges::sort(keys);
+        timeline.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) timeline[i] = static_cast<uint32_t>(keys[i]);
+    }
+
+    bool Beatmap::load(const std::string &filename, const std::string &dir, NoteChart *chart) {
+        path = dir + '/' + filename;
+        if (chart) chart->clear();
         logger->debug("Loading beatmap {}", filename);
-        std::ifstream file(this->path);
+        const MappedFile file(path);
         if (!file.is_open()) {
             logger->error("Failed to open beatmap file: {}", filename);
             return false;
         }
-        rapidjson::IStreamWrapper wrapper(file);
-        rapidjson::Document doc;
-        if (doc.ParseStream(wrapper).HasParseError()) {
-            logger->error("Failed to parse beatmap file: {}", filename);
-            file.close();
+        rapidjson::MemoryStream stream(file.data(), file.size());
+        rapidjson::Reader reader;
+        BeatmapReader handler(*this, dir, chart, file.size());
+        // a file too large to hold in memory is rejected like any other invalid file, it must not end the scan
+        try {
+            const auto result = reader.Parse<rapidjson::kParseDefaultFlags>(stream, handler);
+            if (result.IsError() && result.Code() != rapidjson::kParseErrorTermination) {
+                logger->error("Failed to parse beatmap file {} at offset {}: {}", filename, result.Offset(),
+                    rapidjson::GetParseError_En(result.Code()));
+                return false;
+            }
+            if ((result.IsError() && !handler.error.empty()) || !handler.finish()) {
+                logger->error("Beatmap file is not valid: {}: {}", filename, handler.error);
+                return false;
+            }
+        } catch (const std::bad_alloc &) {
+            logger->error("Beatmap file is not valid: {}: too many notes to load", filename);
+            if (chart) chart->clear();
             return false;
-        }
-        bool flow = doc.HasMember("$schema")
-            && doc["$schema"].IsString()
-            && strcmp(doc["$schema"].GetString(), SCHEMA_URL) == 0
-            && doc.HasMember("version")
-            && doc["version"].IsInt()
-            && doc["version"].GetInt() == SCHEMA_VERSION;
-        if (!flow) {
-            logger->error("Beatmap file is not valid: {}", filename);
+        } catch (const std::length_error &) {
+            logger->error("Beatmap file is not valid: {}: too many notes to load", filename);
+            if (chart) chart->clear();
             return false;
         }
-        try {
-            // TODO: better validating these fields
-            id = doc["id"].GetUint();
-            title = doc["title"].GetString();
-            artist = doc["artist"].GetString();
-            thumbnail_path = dir + '/' + doc["thumbnail"].GetString();
-            music_path = dir + '/' + doc["music"].GetString();
-            preview_point = doc["preview_point"].GetUint();
-            difficulty = doc["difficulty"].GetUint();
-            hp_drain = doc["hp_drain"].GetUint();
-
-            auto note_section = std::move(doc["notes"]);
-            single_note_count = note_section["single_note_count"].GetInt();
-            hold_note_count = note_section["hold_note_count"].GetInt();
-
-            auto channel_0 = note_section["channel_0"].GetArray();
-            for (auto &note : channel_0) {
-                auto start = note[0].GetInt();
-                auto end = note[1].GetInt();
-                notes[0].push_back({start, end});
-            }
-
-            auto channel_1 = note_section["channel_1"].GetArray();
-            for (auto &note : channel_1) {
-                auto start = note[0].GetInt();
-                auto end = note[1].GetInt();
-                notes[1].push_back({start, end});
-            }
-
-            auto channel_2 = note_section["channel_2"].GetArray();
-            for (auto &note : channel_2) {
-                auto start = note[0].GetInt();
-                auto end = note[1].GetInt();
-                notes[2].push_back({start, end});
-            }
-
-            auto channel_3 = note_section["channel_3"].GetArray();
-            for (auto &note : channel_3) {
-                auto start = note[0].GetInt();
-                auto end = note[1].GetInt();
-                notes[3].push_back({start, end});
-            }
-
-            auto channel_4 = note_section["channel_4"].GetArray();
-            for (auto &note : channel_4) {
-                auto start = note[0].GetInt();
-                auto end = note[1].GetInt();
-                notes[4].push_back({start, end});
-            }
-
-            auto channel_5 = note_section["channel_5"].GetArray();
-            for (auto &note : channel_5) {
-                auto start = note[0].GetInt();
-                auto end = note[1].GetInt();
-                notes[5].push_back({start, end});
-            }
-        } catch (const std::exception &e) {
-            logger->error("Failed to load beatmap file {}: {}", filename, e.what());
-            file.close();
+        if (chart) star_rating = rate_chart(*chart);
+        return true;
+    }
+
+    bool Beatmap::load_notes(NoteChart &chart) const {
+        const std::filesystem::path source(path);
+        SourceStamp stamp;
+        if (!read_source_stamp(path, stamp)) {
+            logger->error("Beatmap file not found: {}", path);
             return false;
         }
-        file.close();
+        // a scratch copy, the library entry itself is never touched
+        Beatmap loaded;
+        const auto cache_path = get_cache_path(path);
+        if (loaded.load_cache(cache_path, stamp, path, &chart)) return true;
+        if (!loaded.load(source.filename().string(), source.parent_path().string(), &chart)) return false;
+        if (stamp.hash == 0) stamp.hash = hash_source_file(path);
+        loaded.save_cache(cache_path, stamp, chart);
         return true;
     }
-}
\ No newline at end of file
+}
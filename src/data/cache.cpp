@@ -0,0 +1,247 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "data.h"
+#include "hash.h"
+#include "logging.h"
+#include "mapped_file.h"
+#include "varint.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string_view>
+
+// bump the format version whenever the layout below changes, old files are rebuilt automatically
+#define CACHE_MAGIC 0x31434E41 // "ANC1"
+#define CACHE_FORMAT_VERSION 4
+#define BEATMAPS_CACHE_DIR "cache/beatmaps"
+#define ASSET_HASH_SAMPLE_SIZE (64 * 1024)
+
+const auto logger = anisette::logging::get("cache");
+
+namespace anisette::data
+{
+    /*
+     * Compiled beatmap layout:
+     *   CacheHeader
+     *   title, artist, thumbnail_path, music_path (not null-terminated)
+     *   note_bytes of varint encoded notes, channel 0 to 5, note_count[c] notes each
+     *
+     * Every note is two varints: the zigzag delta of its start to the previous start of the channel, then 0 for a
+     * single note or the zigzag length of a hold note plus 1. Charts are a few bytes per note instead of 8.
+     * The header and strings come first, so a metadata-only load never pages in the notes.
+     */
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint64_t source_hash;
+        uint32_t id;
+        uint32_t preview_point;
+        int32_t single_note_count;
+        int32_t hold_note_count;
+        uint8_t difficulty;
+        uint8_t hp_drain;
+        uint16_t star_rating;
+        uint32_t note_bytes;
+        uint32_t note_count[6];
+        uint32_t string_length[4];
+    };
+    static_assert(sizeof(CacheHeader) == 96);
+
+    static size_t string_size(const CacheHeader &header) {
+        size_t size = 0;
+        for (const auto length : header.string_length) size += length;
+        return size;
+    }
+
+    static void encode_notes(const NoteChart &chart, std::string &out) {
+        for (int c = 0; c < 6; c++) {
+            int32_t previous = 0;
+            for (auto i = chart.channel_begin[c]; i < chart.channel_begin[c + 1]; i++) {
+                utils::put_varint(out, utils::zigzag_encode(chart.start[i] - previous));
+                utils::put_varint(out, chart.end[i] == 0 ? 0 : utils::zigzag_encode(chart.end[i] - chart.start[i]) + 1);
+                previous = chart.start[i];
+            }
+        }
+    }
+
+    static bool decode_notes(const CacheHeader &header, const char *cursor, const char *end, NoteChart &chart) {
+        chart.clear();
+        // every note takes at least 2 bytes, rejects absurd counts before allocating. Summed in 64 bits, so corrupted
+        // counts cannot wrap around to a small total
+        const uint64_t max_notes = header.note_bytes / 2;
+        uint64_t total = 0;
+        for (const auto count : header.note_count) {
+            if (count > max_notes) return false;
+            total += count;
+        }
+        if (total > max_notes) return false;
+        chart.start.resize(total);
+        chart.end.resize(total);
+        uint32_t index = 0;
+        for (int c = 0; c < 6; c++) {
+            chart.channel_begin[c] = index;
+            int32_t previous = 0;
+            for (uint32_t n = 0; n < header.note_count[c] && index < total; n++, index++) {
+                uint32_t delta, length;
+                if (!utils::get_varint(cursor, end, delta) || !utils::get_varint(cursor, end, length)) return false;
+                previous += utils::zigzag_decode(delta);
+                chart.start[index] = previous;
+                chart.end[index] = length == 0 ? 0 : previous + utils::zigzag_decode(length - 1);
+            }
+        }
+        chart.channel_begin[6] = index;
+        if (cursor != end) return false;
+        chart.build_timeline();
+        return true;
+    }
+
+    /*
+     * Write a cache file to a temporary file first, so a crash never leaves a half-written cache behind and a reader
+     * mapping the old file keeps a consistent copy. The temporary name is unique per write: the scan and the stage may
+     * save the same entry at the same time, and the last rename wins with a complete file either way.
+     */
+    static bool write_cache_file(const std::string &cache_path, const CacheHeader &header,
+                                 const std::initializer_list<std::string_view> parts) {
+        static std::atomic_uint32_t temp_serial = 0;
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(cache_path).parent_path(), ec);
+        const auto temp_path = cache_path + '.' + std::to_string(++temp_serial) + ".tmp";
+        {
+            std::ofstream ofs(temp_path, std::ios::binary | std::ios::trunc);
+            if (!ofs.is_open()) {
+                logger->error("Failed to open beatmap cache for writing: {}", temp_path);
+                return false;
+            }
+            ofs.write(reinterpret_cast<const char *>(&header), sizeof(CacheHeader));
+            for (const auto part : parts) ofs.write(part.data(), static_cast<std::streamsize>(part.size()));
+            if (!ofs.good()) {
+                logger->error("Failed to write beatmap cache: {}", temp_path);
+                ofs.close();
+                std::filesystem::remove(temp_path, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(temp_path, cache_path, ec);
+        if (ec) {
+            logger->error("Failed to commit beatmap cache {}: {}", cache_path, ec.message());
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t hash_source_file(const std::string &path) {
+        const MappedFile file(path);
+        if (!file.is_open()) return 0;
+        return utils::fnv1a64(file.data(), file.size());
+    }
+
+    uint64_t hash_asset_file(const std::string &path) {
+        const MappedFile file(path);
+        if (!file.is_open()) return 0;
+        const size_t size = file.size();
+        uint64_t hash = utils::fnv1a64(&size, sizeof(size));
+        if (size <= ASSET_HASH_SAMPLE_SIZE * 3) return utils::fnv1a64(file.data(), size, hash);
+        // head, middle and tail, only these pages of the mapping are ever read
+        for (const size_t offset : {size_t {0}, (size - ASSET_HASH_SAMPLE_SIZE) / 2, size - ASSET_HASH_SAMPLE_SIZE}) {
+            hash = utils::fnv1a64(file.data() + offset, ASSET_HASH_SAMPLE_SIZE, hash);
+        }
+        return hash;
+    }
+
+    bool read_source_stamp(const std::string &path, SourceStamp &stamp) {
+        std::error_code ec;
+        stamp.size = std::filesystem::file_size(path, ec);
+        if (ec) return false;
+        stamp.mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        stamp.hash = 0;
+        return !ec;
+    }
+
+    std::string get_cache_path(const std::string &source_path) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(utils::fnv1a64(source_path)));
+        return std::string(BEATMAPS_CACHE_DIR) + '/' + name;
+    }
+
+    bool Beatmap::load_cache(const std::string &cache_path, SourceStamp &stamp, const std::string &source_path,
+                             NoteChart *chart) {
+        MappedFile file(cache_path);
+        if (!file.is_open() || file.size() < sizeof(CacheHeader)) return false;
+        CacheHeader header {};
+        memcpy(&header, file.data(), sizeof(CacheHeader));
+        if (header.magic != CACHE_MAGIC || header.version != CACHE_FORMAT_VERSION) return false;
+        if (header.source_size != stamp.size) return false;
+        bool refresh_header = false;
+        if (header.source_mtime != stamp.mtime) {
+            // the file was touched, only rebuild if the content really changed
+            if (stamp.hash == 0) stamp.hash = hash_source_file(source_path);
+            if (stamp.hash != header.source_hash) return false;
+            refresh_header = true;
+        }
+        stamp.hash = header.source_hash;
+        // bounds check before touching the payload
+        if (sizeof(CacheHeader) + string_size(header) + header.note_bytes != file.size()) {
+            logger->warn("Corrupted beatmap cache: {}", cache_path);
+            return false;
+        }
+
+        const char *cursor = file.data() + sizeof(CacheHeader);
+        std::string *strings[4] = {&title, &artist, &thumbnail_path, &music_path};
+        for (int i = 0; i < 4; i++) {
+            strings[i]->assign(cursor, header.string_length[i]);
+            cursor += header.string_length[i];
+        }
+        if (chart && !decode_notes(header, cursor, file.data() + file.size(), *chart)) {
+            logger->warn("Corrupted beatmap cache: {}", cache_path);
+            chart->clear();
+            return false;
+        }
+        path = source_path;
+        id = header.id;
+        preview_point = header.preview_point;
+        single_note_count = header.single_note_count;
+        hold_note_count = header.hold_note_count;
+        difficulty = header.difficulty;
+        hp_drain = header.hp_drain;
+        star_rating = header.star_rating;
+
+        if (refresh_header) {
+            // only the stamp changes, the payload is copied as it is. Rewritten whole, never patched in place
+            const std::string payload(file.data() + sizeof(CacheHeader), file.size() - sizeof(CacheHeader));
+            file.close();
+            header.source_mtime = stamp.mtime;
+            write_cache_file(cache_path, header, {payload});
+        }
+        return true;
+    }
+
+    bool Beatmap::save_cache(const std::string &cache_path, const SourceStamp &stamp, const NoteChart &chart) const {
+        CacheHeader header {};
+        header.magic = CACHE_MAGIC;
+        header.version = CACHE_FORMAT_VERSION;
+        header.source_size = stamp.size;
+        header.source_mtime = stamp.mtime;
+        header.source_hash = stamp.hash;
+        header.id = id;
+        header.preview_point = preview_point;
+        header.single_note_count = single_note_count;
+        header.hold_note_count = hold_note_count;
+        header.difficulty = difficulty;
+        header.hp_drain = hp_drain;
+        header.star_rating = star_rating;
+        for (int i = 0; i < 6; i++) header.note_count[i] = chart.channel_size(i);
+        std::string notes;
+        encode_notes(chart, notes);
+        header.note_bytes = static_cast<uint32_t>(notes.size());
+        const std::string *strings[4] = {&title, &artist, &thumbnail_path, &music_path};
+        for (int i = 0; i < 4; i++) header.string_length[i] = static_cast<uint32_t>(strings[i]->size());
+        return write_cache_file(cache_path, header, {title, artist, thumbnail_path, music_path, notes});
+    }
+}
@@ -2,8 +2,15 @@
 // Created by Yuuki on 02/04/2025.
 //
 #pragma once
+#include "flat_index.h"
+#include "string_arena.h"
 #include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <vector>
 #include <unordered_map>
@@ -20,16 +27,123 @@ namespace anisette::data {
         BY_TITLE,
         BY_ARTIST,
         BY_DIFFICULTY,
-        NONE
+        BY_STAR_RATING,
+        NONE // directory order, also the number of sort orders
     } SortStrategy;
 
+    // a single note as written in the beatmap file, end is 0 for single notes
     struct Note {
         int start, end;
     };
 
+    /**
+     * @brief Notes of a beatmap, only loaded for the map being played
+     *
+     * Notes are stored as columns: channel c owns the slice [channel_begin[c], channel_begin[c + 1]) of start and end,
+     * sorted by start time. The timeline holds the index of every note of every channel, sorted by start time and
+     * then by channel, for consumers that need the notes in play order.
+     */
+    struct NoteChart {
+        std::vector<int32_t> start;
+        std::vector<int32_t> end;
+        uint32_t channel_begin[7] {};
+        std::vector<uint32_t> timeline;
+
+        [[nodiscard]] uint32_t size() const {
+            return static_cast<uint32_t>(start.size());
+        }
+
+        [[nodiscard]] uint32_t channel_size(const int channel) const {
+            return channel_begin[channel + 1] - channel_begin[channel];
+        }
+
+        void clear() {
+            start.clear();
+            end.clear();
+            timeline.clear();
+            for (auto &begin : channel_begin) begin = 0;
+        }
+
+        /**
+         * @brief Rebuild the timeline from the columns
+         */
+        void build_timeline();
+    };
+
+    /**
+     * @brief Star rating of a note chart in hundredths of a star
+     *
+     * Combines note density, jack, chord and hold strain over overlapping sections of the chart,
+     * the hardest sections weigh the most.
+     */
+    uint16_t rate_chart(const NoteChart &chart);
+
+    // identity of a beatmap source file, used to validate the compiled cache
+    struct SourceStamp {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint64_t hash = 0;
+    };
+
+    /**
+     * @brief Content hash of a beatmap source file, 0 if the file cannot be read
+     */
+    uint64_t hash_source_file(const std::string &path);
+
+    /**
+     * @brief Content id of a music or image file, 0 if the file cannot be read
+     *
+     * Hashes the size and a few sampled blocks instead of the whole file, so a scan can afford it for every asset.
+     * Equal ids mean the same content, whatever the path, so engine caches are keyed by it.
+     */
+    uint64_t hash_asset_file(const std::string &path);
+
+    /**
+     * @brief Fill the size and mtime of a beatmap source file
+     */
+    bool read_source_stamp(const std::string &path, SourceStamp &stamp);
+
+    /**
+     * @brief Path of the compiled cache file of a beatmap source file
+     */
+    std::string get_cache_path(const std::string &source_path);
+
     class Beatmap {
     public:
-        bool load(const std::string &filename, const std::string &dir);
+        /**
+         * @brief Parse the beatmap JSON source
+         *
+         * @param filename Source file name
+         * @param dir Directory of the beatmap set
+         * @param chart Note chart to fill, if null only the header fields are read and the star rating is not computed
+         */
+        bool load(const std::string &filename, const std::string &dir, NoteChart *chart = nullptr);
+
+        /**
+         * @brief Load the beatmap from its compiled binary cache
+         *
+         * The cache is memory-mapped and copied directly into this object without parsing.
+         *
+         * @param cache_path Path of the compiled cache file
+         * @param stamp Stamp of the current source file, hash is filled in if it had to be computed
+         * @param source_path Path of the source file, hashed only when the size matches but the mtime does not
+         * @param chart Note chart to fill, if null the note section of the cache is never touched
+         * @return false if the cache is missing, corrupted or stale
+         */
+        bool load_cache(const std::string &cache_path, SourceStamp &stamp, const std::string &source_path,
+                        NoteChart *chart = nullptr);
+
+        /**
+         * @brief Write the compiled binary cache of this beatmap
+         */
+        bool save_cache(const std::string &cache_path, const SourceStamp &stamp, const NoteChart &chart) const;
+
+        /**
+         * @brief Load the notes of this beatmap on demand
+         *
+         * Reads the compiled cache if it is still valid, otherwise parses the source and rebuilds the cache.
+         */
+        bool load_notes(NoteChart &chart) const;
 
         unsigned id = 0;
         std::string path;
@@ -42,18 +156,293 @@ namespace anisette::data {
         unsigned preview_point = 0;
         uint8_t difficulty = 0;
         uint8_t hp_drain = 0;
-        std::vector<Note> notes[6];
+        // computed from the notes, in hundredths of a star
+        uint16_t star_rating = 0;
+        // content ids of the music and thumbnail files, shared by every difficulty using the same file
+        uint64_t music_id = 0;
+        uint64_t thumbnail_id = 0;
+    };
+
+    enum RecordFlag : uint8_t {
+        PATH_IN_DIR = 1 << 0,
+        THUMBNAIL_IN_DIR = 1 << 1,
+        MUSIC_IN_DIR = 1 << 2,
+    };
+
+    /**
+     * @brief Fixed-size header of a beatmap in a library snapshot
+     *
+     * Strings are interned in the arena of the snapshot. A path is split into the set directory, shared by every
+     * difficulty of the set, and the name inside it; the matching flag is clear if the path is not in the directory,
+     * the name then holds the whole path.
+     */
+    struct BeatmapRecord {
+        uint64_t music_id;
+        uint64_t thumbnail_id;
+        unsigned id;
+        utils::StringRef dir;
+        utils::StringRef file;
+        utils::StringRef title;
+        utils::StringRef artist;
+        utils::StringRef thumbnail;
+        utils::StringRef music;
+        int32_t single_note_count;
+        int32_t hold_note_count;
+        uint32_t preview_point;
+        uint16_t star_rating;
+        uint8_t difficulty;
+        uint8_t hp_drain;
+        uint8_t flags;
+    };
+
+    // one beatmap source file in the library manifest
+    struct ManifestFile {
+        std::string name;
+        SourceStamp stamp;
+        Beatmap beatmap;
+    };
+
+    // a source file that failed to load, parsed again once its stamp changes
+    struct ManifestFailure {
+        std::string name;
+        SourceStamp stamp;
+    };
+
+    // one beatmap set directory in the library manifest
+    struct ManifestDirectory {
+        int64_t mtime = 0;
+        std::vector<ManifestFile> files;
+        std::vector<ManifestFailure> failed;
+    };
+
+    // set directory path -> directory content, ordered to keep the library order stable
+    typedef std::map<std::string, ManifestDirectory> Manifest;
+
+    bool load_manifest(const std::string &path, Manifest &manifest);
+    bool save_manifest(const std::string &path, const Manifest &manifest);
+
+    /**
+     * @brief Reference to a beatmap that survives library rescans
+     *
+     * The slot is only trusted while the generation matches the snapshot it is resolved against,
+     * otherwise the handle is looked up again by beatmap ID.
+     */
+    struct BeatmapHandle {
+        unsigned id = 0;
+        uint32_t slot = utils::FlatIndex::NOT_FOUND;
+        uint32_t generation = 0;
+
+        bool valid() const {
+            return slot != utils::FlatIndex::NOT_FOUND;
+        }
+    };
+
+    /**
+     * @brief Case-insensitive trigram index over the title and artist of a beatmap list
+     */
+    class SearchIndex {
+    public:
+        void build(const std::vector<BeatmapRecord> &records, const utils::StringArena &strings);
+
+        /**
+         * @brief Split a query into lowercase terms
+         */
+        static std::vector<std::string> split_query(std::string_view query);
+
+        /**
+         * @brief Slots that may contain every term, in ascending slot order
+         *
+         * Terms shorter than a trigram are looked up as word prefixes.
+         */
+        void collect_candidates(const std::vector<std::string> &terms, std::vector<uint32_t> &candidates) const;
+
+        /**
+         * @brief Match score of a slot against every term, lower is better
+         *
+         * @return -1 if a term is not found in the title or artist
+         */
+        int score(uint32_t slot, const std::vector<std::string> &terms) const;
+
+    private:
+        // lowercase "title\nartist" of every slot, back to back
+        std::string text;
+        std::vector<uint32_t> text_offsets;
+        std::vector<uint32_t> title_lengths;
+        // trigram -> posting list, posting lists are stored back to back in ascending slot order
+        utils::FlatIndex trigrams;
+        std::vector<uint32_t> posting_offsets;
+        std::vector<uint32_t> postings;
+    };
+
+    /**
+     * @brief Immutable beatmap list published by a library scan
+     *
+     * A snapshot is never modified after it is published, any thread can read it without locking
+     * for as long as it holds a reference.
+     *
+     * Beatmaps are stored as fixed-size records in directory order, with every string interned in a single arena,
+     * so the whole library is a handful of contiguous allocations. Use get() for a full Beatmap.
+     */
+    class LibrarySnapshot {
+    public:
+        LibrarySnapshot(uint32_t generation, const std::vector<Beatmap> &beatmaps);
+
+        /**
+         * @brief Get the record of a handle, re-resolving it by ID if it comes from an older snapshot
+         *
+         * @return null if the beatmap is no longer in the library
+         */
+        const BeatmapRecord* resolve(BeatmapHandle &handle) const;
+
+        /**
+         * @brief Find a beatmap by ID, O(1)
+         */
+        BeatmapHandle find(unsigned id) const;
+
+        BeatmapHandle handle_at(size_t slot) const;
+
+        /**
+         * @brief Slot of the beatmap at a position of a sort order, O(1)
+         */
+        uint32_t slot_at(SortStrategy strategy, bool ascending, size_t position) const;
+
+        /**
+         * @brief Position of a slot in a sort order, O(1)
+         */
+        size_t position_of(SortStrategy strategy, bool ascending, uint32_t slot) const;
+
+        /**
+         * @brief Find beatmaps whose title or artist contains every word of the query
+         *
+         * Title prefix matches rank first, then word starts, then substrings, then artist matches.
+         * Equal matches keep the given sort order.
+         *
+         * @return Matching slots, best match first
+         */
+        std::vector<uint32_t> search(std::string_view query, SortStrategy strategy, bool ascending) const;
+
+        [[nodiscard]] size_t size() const {
+            return records.size();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return records.empty();
+        }
+
+        // in directory order, use slot_at to walk a sorted view
+        [[nodiscard]] const BeatmapRecord &record(const uint32_t slot) const {
+            return records[slot];
+        }
+
+        [[nodiscard]] std::string_view string(const utils::StringRef ref) const {
+            return strings.get(ref);
+        }
+
+        [[nodiscard]] size_t string_bytes() const {
+            return strings.size();
+        }
+
+        /**
+         * @brief Rebuild the full beatmap of a slot, for the few beatmaps that are shown or played
+         */
+        [[nodiscard]] Beatmap get(uint32_t slot) const;
+
+        const uint32_t generation;
+
+    private:
+        void build_sort_indexes();
+
+        std::vector<BeatmapRecord> records;
+        utils::StringArena strings;
+        utils::FlatIndex index;
+        SearchIndex search_index;
+        // permutation and inverse permutation of the slots for every strategy, ascending
+        std::vector<uint32_t> orders[NONE];
+        std::vector<uint32_t> positions[NONE];
+    };
+
+    typedef std::shared_ptr<const LibrarySnapshot> LibraryRef;
+
+    // number of set directories processed by the running scan
+    struct ScanProgress {
+        uint32_t done = 0;
+        uint32_t total = 0;
     };
 
     class BeatmapLoader {
     public:
-        void scan(SortStrategy sort_strategy, bool ascending = true);
+        BeatmapLoader();
+
+        /**
+         * @brief Scan the beatmaps root directory in the background
+         *
+         * The scan is incremental: headers of unchanged files come from the persisted library manifest,
+         * only new or modified files are read again.
+         *
+         * @param workers Number of directories parsed in parallel, 0 means use all hardware threads
+         */
+        void scan(unsigned workers = 0);
+
+        /**
+         * @brief Watch the beatmaps root directory and rescan changed set directories in the background
+         *
+         * Only supported on Linux (inotify), a no-op on other platforms.
+         */
+        void watch();
+
+        /**
+         * @brief Get the latest published library snapshot, never null
+         *
+         * During the first scan, partial snapshots are published as directories finish,
+         * so the list may grow until is_scan_finished() returns true.
+         *
+         * Readers should keep the returned reference and compare generation() every frame,
+         * loading a new snapshot only when it changed.
+         */
+        LibraryRef snapshot() const;
+
+        /**
+         * @brief Generation of the latest published snapshot, lock-free
+         */
+        uint32_t generation() const;
+
+        /**
+         * @brief Progress of the running scan, lock-free
+         */
+        ScanProgress get_scan_progress() const;
+
+        /**
+         * @brief Progress of rating the beatmaps parsed by the last scan, after it was published, lock-free
+         */
+        ScanProgress get_rating_progress() const;
+
         bool is_scan_finished();
-        Beatmap* get_beatmap(int id);
-        std::unordered_map<int, int> index;
-        std::vector<Beatmap> beatmaps;
+
+        /**
+         * @brief Whether no scan is running: the last one rated its beatmaps, compiled their caches and saved the
+         * manifest, lock-free
+         *
+         * is_scan_finished() turns true as soon as the library is published, before any of that.
+         */
+        bool is_idle() const;
 
     private:
+        void update_library(const std::set<std::string> *dirty_directories);
+        void publish(const std::vector<Beatmap> &list);
+
         std::atomic_bool load_finished;
+        std::atomic_bool idle = false;
+        unsigned workers = 0;
+        // scans never run concurrently, the manifest is only touched while holding this lock
+        std::mutex scan_mutex;
+        Manifest manifest;
+        bool manifest_loaded = false;
+        // replaced as a whole, never modified in place
+        std::atomic<LibraryRef> published;
+        std::atomic_uint32_t published_generation = 0;
+        std::atomic_uint32_t scan_done = 0;
+        std::atomic_uint32_t scan_total = 0;
+        std::atomic_uint32_t rate_done = 0;
+        std::atomic_uint32_t rate_total = 0;
     };
 }
\ No newline at end of file
@@ -3,71 +3,504 @@
 //
 #include "data.h"
 #include "logging.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <ranges>
 #include <thread>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 #define BEATMAPS_ROOT_DIR "beatmaps"
+#define LIBRARY_MANIFEST_PATH "cache/library.bin"
+#define WATCH_DEBOUNCE_MS 500
+#define STREAM_PUBLISH_MIN_SIZE 256
 
 const auto logger = anisette::logging::get("data");
 
 namespace anisette::data
 {
-    void BeatmapLoader::scan(const SortStrategy sort_strategy, bool ascending) {
-        std::thread t([this, sort_strategy, ascending]() {
-            index.clear();
-            beatmaps.clear();
-            load_finished = false;
+    static std::atomic_uint cache_hit_count = 0;
+    static std::atomic_uint parsed_count = 0;
+
+    /**
+     * @brief Load the header of a beatmap from the compiled cache, or from the JSON source if the cache is stale
+     *
+     * Notes are never read here, they are loaded on demand by Beatmap::load_notes.
+     *
+     * @param parsed Set if the header came from the JSON source, the beatmap has no star rating yet
+     */
+    static bool load_beatmap(ManifestFile &entry, const std::filesystem::path &file, const std::string &dir,
+                             bool &parsed) {
+        const auto source_path = file.string();
+        parsed = false;
+        if (entry.beatmap.load_cache(get_cache_path(source_path), entry.stamp, source_path)) {
+            ++cache_hit_count;
+            return true;
+        }
+        if (!entry.beatmap.load(file.filename().string(), dir)) return false;
+        if (entry.stamp.hash == 0) entry.stamp.hash = hash_source_file(source_path);
+        ++parsed_count;
+        parsed = true;
+        return true;
+    }
+
+    /**
+     * @brief Parse the notes of a beatmap, rate them and write the compiled cache
+     *
+     * The cache keeps the rating, so this runs once per source change. A beatmap whose notes cannot be parsed
+     * stays in the library unrated, like before, and fails when it is played.
+     */
+    static void rate_beatmap(ManifestFile &entry) {
+        const std::filesystem::path source(entry.beatmap.path);
+        Beatmap loaded;
+        NoteChart chart;
+        if (!loaded.load(source.filename().string(), source.parent_path().string(), &chart)) return;
+        entry.beatmap.star_rating = loaded.star_rating;
+        loaded.save_cache(get_cache_path(entry.beatmap.path), entry.stamp, chart);
+    }
+
+    static int64_t get_mtime(const std::filesystem::path &path) {
+        std::error_code ec;
+        const auto time = std::filesystem::last_write_time(path, ec);
+        return ec ? 0 : time.time_since_epoch().count();
+    }
+
+    /**
+     * @brief Fill the music and thumbnail content ids of a refreshed directory
+     *
+     * Difficulties of a set share their files, every file is hashed once per directory.
+     *
+     * @param previous Previous manifest entry, its ids are reused unless rehash is set
+     * @param rehash Hash every file again, for directories reported by the watcher where files may be replaced in place
+     * @return true if any id changed
+     */
+    static bool update_asset_ids(const ManifestDirectory *previous, ManifestDirectory &result, const bool rehash) {
+        std::unordered_map<std::string, uint64_t> ids;
+        if (previous && !rehash) {
+            for (const auto &file : previous->files) {
+                ids.emplace(file.beatmap.music_path, file.beatmap.music_id);
+                ids.emplace(file.beatmap.thumbnail_path, file.beatmap.thumbnail_id);
+            }
+        }
+        const auto get_id = [&ids](const std::string &path) -> uint64_t {
+            if (path.empty()) return 0;
+            const auto [it, inserted] = ids.try_emplace(path, 0);
+            if (inserted) it->second = hash_asset_file(path);
+            return it->second;
+        };
+        bool changed = false;
+        for (auto &file : result.files) {
+            const auto music_id = get_id(file.beatmap.music_path);
+            const auto thumbnail_id = get_id(file.beatmap.thumbnail_path);
+            changed |= music_id != file.beatmap.music_id || thumbnail_id != file.beatmap.thumbnail_id;
+            file.beatmap.music_id = music_id;
+            file.beatmap.thumbnail_id = thumbnail_id;
+        }
+        return changed;
+    }
+
+    /**
+     * @brief Refresh one set directory against its previous manifest entry
+     *
+     * @param dir Set directory path
+     * @param previous Previous manifest entry, null if the directory is new
+     * @param result Refreshed manifest entry
+     * @param rehash_assets Hash the music and thumbnail files again even if the directory looks unchanged
+     * @param unrated Filled with the index of every file of the result that still needs rate_beatmap
+     * @return true if anything in the directory changed
+     */
+    static bool refresh_directory(const std::string &dir, const ManifestDirectory *previous, ManifestDirectory &result,
+                                  const bool rehash_assets, std::vector<uint32_t> &unrated) {
+        result.mtime = get_mtime(dir);
+        std::vector<std::string> names;
+        if (previous && previous->mtime == result.mtime) {
+            // no file was added, removed or renamed, only check the known files for in-place edits, failed ones too
+            for (const auto &file : previous->files) names.push_back(file.name);
+            for (const auto &file : previous->failed) names.push_back(file.name);
+        } else {
+            try {
+                for (const auto& file : std::filesystem::directory_iterator(dir)) {
+                    if (file.path().extension() == ".json") names.push_back(file.path().filename().string());
+                }
+            } catch (const std::filesystem::filesystem_error &e) {
+                logger->error("Failed to scan directory {}: {}", dir, e.what());
+                // keep what we knew about the directory until it can be read again
+                if (previous) {
+                    result.files = previous->files;
+                    result.failed = previous->failed;
+                }
+                return false;
+            }
+        }
+        std::ranges::sort(names);
+        bool changed = !previous || previous->files.size() + previous->failed.size() != names.size();
+        for (const auto &name : names) {
+            const std::filesystem::path file = std::filesystem::path(dir) / name;
+            ManifestFile entry {name};
+            if (!read_source_stamp(file.string(), entry.stamp)) {
+                changed = true;
+                continue;
+            }
+            // a file that failed to load is only read again once edited
+            if (previous) {
+                const auto it = std::ranges::find(previous->failed, name, &ManifestFailure::name);
+                if (it != previous->failed.end() && it->stamp.size == entry.stamp.size
+                    && it->stamp.mtime == entry.stamp.mtime) {
+                    result.failed.push_back(*it);
+                    continue;
+                }
+            }
+            // reuse the parsed header if the file is unchanged
+            const ManifestFile *known = nullptr;
+            if (previous) {
+                const auto it = std::ranges::find(previous->files, name, &ManifestFile::name);
+                if (it != previous->files.end() && it->stamp.size == entry.stamp.size) known = &*it;
+            }
+            if (known && known->stamp.mtime != entry.stamp.mtime) {
+                // touched, compare the content before parsing again
+                entry.stamp.hash = hash_source_file(file.string());
+                if (entry.stamp.hash != known->stamp.hash) known = nullptr;
+            }
+            if (known) {
+                entry.beatmap = known->beatmap;
+                entry.stamp.hash = known->stamp.hash;
+                changed |= known->stamp.mtime != entry.stamp.mtime;
+                result.files.push_back(std::move(entry));
+                continue;
+            }
+            changed = true;
+            bool parsed;
+            if (!load_beatmap(entry, file, dir, parsed)) {
+                result.failed.push_back({name, entry.stamp});
+                continue;
+            }
+            if (parsed) unrated.push_back(static_cast<uint32_t>(result.files.size()));
+            result.files.push_back(std::move(entry));
+        }
+        // a new file list may reference other assets, only an untouched directory keeps its ids
+        const bool rehash = rehash_assets || !previous || previous->mtime != result.mtime;
+        if (update_asset_ids(previous, result, rehash)) changed = true;
+        return changed;
+    }
+
+    void BeatmapLoader::update_library(const std::set<std::string> *dirty_directories) {
+        std::lock_guard lock(scan_mutex);
+        idle = false;
+        const auto start = std::chrono::steady_clock::now();
+        if (!manifest_loaded) {
+            load_manifest(LIBRARY_MANIFEST_PATH, manifest);
+            manifest_loaded = true;
+        }
+        cache_hit_count = 0;
+        parsed_count = 0;
+        // collect the set directories first, sorted to keep the merge order stable between runs
+        std::vector<std::string> directories;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(BEATMAPS_ROOT_DIR, ec)) {
+            if (entry.is_directory()) directories.push_back(entry.path().string());
+        }
+        if (ec) logger->error("Failed to list beatmaps root directory: {}", ec.message());
+        std::ranges::sort(directories);
+        // directories that are not dirty are reused as they are
+        std::vector<size_t> jobs;
+        for (size_t i = 0; i < directories.size(); i++) {
+            if (!dirty_directories || dirty_directories->contains(directories[i]) || !manifest.contains(directories[i])) {
+                jobs.push_back(i);
+            }
+        }
+        // each worker only writes to the result slot of its own directory
+        std::vector<ManifestDirectory> results(jobs.size());
+        std::vector<std::vector<uint32_t>> unrated(jobs.size());
+        std::atomic_bool changed = manifest.size() != directories.size();
+        scan_done = 0;
+        scan_total = static_cast<uint32_t>(jobs.size());
+        // while nothing is published yet, stream partial snapshots so the UI can start early;
+        // the threshold doubles every time, so the total copy cost stays linear
+        const bool streaming = !load_finished;
+        std::vector<Beatmap> streamed;
+        size_t next_publish_size = STREAM_PUBLISH_MIN_SIZE;
+        std::mutex stream_mutex;
+        utils::parallel_for(jobs.size(), workers, [&](const size_t i) {
+            const auto &dir = directories[jobs[i]];
+            const auto it = manifest.find(dir);
+            const auto previous = it == manifest.end() ? nullptr : &it->second;
+            // the watcher also reports replaced music and images, which never change the directory mtime
+            if (refresh_directory(dir, previous, results[i], dirty_directories != nullptr, unrated[i])) changed = true;
+            ++scan_done;
+            if (!streaming) return;
+            std::lock_guard stream_lock(stream_mutex);
+            for (const auto &file : results[i].files) streamed.push_back(file.beatmap);
+            if (streamed.size() < next_publish_size || scan_done == scan_total) return;
+            publish(streamed);
+            next_publish_size = streamed.size() * 2;
+        });
+        Manifest next;
+        for (size_t i = 0; i < jobs.size(); i++) next.emplace(directories[jobs[i]], std::move(results[i]));
+        for (const auto &dir : directories) {
+            if (!next.contains(dir)) next.emplace(dir, std::move(manifest[dir]));
+        }
+        manifest = std::move(next);
+
+        // merge in directory order
+        const auto merge = [this] {
+            std::vector<Beatmap> list;
+            for (const auto &directory : manifest | std::views::values) {
+                for (const auto &file : directory.files) list.push_back(file.beatmap);
+            }
+            return list;
+        };
+        const auto list = merge();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        logger->debug("Scanning beatmaps finished in {}ms: {} beatmaps from {} directories ({} refreshed), "
+            "{} loaded from cache, {} parsed", elapsed.count(), list.size(), directories.size(), jobs.size(),
+            cache_hit_count.load(), parsed_count.load());
+
+        // the first scan is always published, even if the manifest was already up to date
+        if (changed || !load_finished) publish(list);
+
+        // beatmaps parsed from JSON are rated after they are published, the library shows up without waiting for it
+        std::vector<ManifestFile *> unrated_files;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            auto &files = manifest[directories[jobs[i]]].files;
+            for (const auto index : unrated[i]) unrated_files.push_back(&files[index]);
+        }
+        // rating has its own counters, set before the load is reported finished so the progress never looks done early
+        rate_done = 0;
+        rate_total = static_cast<uint32_t>(unrated_files.size());
+        if (!load_finished) {
+            load_finished = true;
+            logger->info("Load beatmaps finished");
+        }
+        if (!unrated_files.empty()) {
+            const auto rating_start = std::chrono::steady_clock::now();
+            utils::parallel_for(unrated_files.size(), workers, [&](const size_t i) {
+                rate_beatmap(*unrated_files[i]);
+                ++rate_done;
+            });
+            publish(merge());
+            logger->debug("Rated {} beatmaps in {}ms", unrated_files.size(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - rating_start).count());
+        }
+        // only saved once rated, an unrated entry would be reused as it is by the next scan
+        if (changed) save_manifest(LIBRARY_MANIFEST_PATH, manifest);
+        idle = true;
+    }
+
+    void BeatmapLoader::scan(const unsigned workers) {
+        this->workers = workers;
+        std::thread t([this]() {
             if (!std::filesystem::exists(BEATMAPS_ROOT_DIR)) {
                 logger->error("Beatmaps root directory not found");
                 load_finished = true;
+                idle = true;
                 return;
             }
             logger->info("Scanning beatmaps");
-            for (const auto& entry : std::filesystem::directory_iterator(BEATMAPS_ROOT_DIR)) {
-                if (!entry.is_directory()) continue;
-                for (const auto& file : std::filesystem::directory_iterator(entry.path())) {
-                    if (file.path().extension() != ".json") continue;
-                    Beatmap beatmap {};
-                    if (!beatmap.load(file.path().filename().string(), entry.path().string())) continue;
-                    beatmaps.push_back(beatmap);
-                }
+            update_library(nullptr);
+        });
+        t.detach();
+    }
+
+    void BeatmapLoader::watch() {
+#ifdef __linux__
+        std::thread t([this]() {
+            const int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+            if (fd < 0) {
+                logger->error("Failed to initialize inotify, beatmaps directory will not be watched");
+                return;
+            }
+            constexpr uint32_t ROOT_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+            constexpr uint32_t SET_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+            std::unordered_map<int, std::string> watched;
+            const int root_wd = inotify_add_watch(fd, BEATMAPS_ROOT_DIR, ROOT_MASK);
+            if (root_wd < 0) {
+                logger->error("Failed to watch beatmaps root directory");
+                close(fd);
+                return;
             }
-            logger->debug("Scanning beatmaps finished");
-            if (sort_strategy != NONE) {
-                // sort
-                std::ranges::sort(beatmaps, [sort_strategy, ascending](const Beatmap &a, const Beatmap &b) {
-                    bool res = false;
-                    switch (sort_strategy) {
-                        case BY_ID:
-                            res = a.id > b.id;
-                        case BY_TITLE:
-                            res = a.title > b.title;
-                        case BY_ARTIST:
-                            res = a.artist > b.artist;
-                        case BY_DIFFICULTY:
-                            res = a.difficulty > b.difficulty;
-                        break;
-                        default: break;
+            const auto add_set_watch = [fd, &watched](const std::string &dir) {
+                const int wd = inotify_add_watch(fd, dir.c_str(), SET_MASK);
+                if (wd >= 0) watched[wd] = dir;
+            };
+            std::error_code ec;
+            for (const auto& entry : std::filesystem::directory_iterator(BEATMAPS_ROOT_DIR, ec)) {
+                if (entry.is_directory()) add_set_watch(entry.path().string());
+            }
+            logger->info("Watching beatmaps directory for changes");
+
+            std::set<std::string> dirty;
+            bool full_rescan = false;
+            alignas(inotify_event) char buffer[4096];
+            while (true) {
+                pollfd pfd {fd, POLLIN, 0};
+                const int ready = poll(&pfd, 1, WATCH_DEBOUNCE_MS);
+                if (ready < 0) break;
+                if (ready == 0) {
+                    // quiet for a while, flush the collected changes
+                    if (full_rescan) update_library(nullptr);
+                    else if (!dirty.empty()) update_library(&dirty);
+                    dirty.clear();
+                    full_rescan = false;
+                    continue;
+                }
+                const ssize_t length = read(fd, buffer, sizeof(buffer));
+                if (length <= 0) continue;
+                for (ssize_t offset = 0; offset < length;) {
+                    const auto event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                    offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        full_rescan = true;
+                        continue;
                     }
-                    return res ^ ascending;
-                });
+                    if (event->wd == root_wd) {
+                        if (!(event->mask & IN_ISDIR) || event->len == 0) continue;
+                        const auto dir = std::string(BEATMAPS_ROOT_DIR) + '/' + event->name;
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO)) add_set_watch(dir);
+                        dirty.insert(dir);
+                    } else if (const auto it = watched.find(event->wd); it != watched.end()) {
+                        if (event->mask & IN_IGNORED) {
+                            watched.erase(it);
+                            continue;
+                        }
+                        dirty.insert(it->second);
+                    }
+                }
             }
-            // end
-            load_finished = true;
-            logger->info("Load beatmaps finished");
+            close(fd);
         });
         t.detach();
+#else
+        logger->info("Watching beatmaps directory is not supported on this platform");
+#endif
+    }
+
+    void BeatmapLoader::publish(const std::vector<Beatmap> &list) {
+        const auto next = std::make_shared<const LibrarySnapshot>(published_generation + 1, list);
+        published.store(next, std::memory_order_release);
+        // readers poll the generation first, so it must change after the snapshot is in place
+        published_generation = next->generation;
+        logger->info("Published beatmap library generation {}, {} beatmaps ({} KB of strings)", next->generation,
+                     next->size(), next->string_bytes() / 1024);
+    }
+
+    LibraryRef BeatmapLoader::snapshot() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+    uint32_t BeatmapLoader::generation() const {
+        return published_generation;
+    }
+
+    ScanProgress BeatmapLoader::get_scan_progress() const {
+        return {scan_done, scan_total};
+    }
+
+    ScanProgress BeatmapLoader::get_rating_progress() const {
+        return {rate_done, rate_total};
     }
 
     bool BeatmapLoader::is_scan_finished() {
         return load_finished;
     }
 
-    Beatmap* BeatmapLoader::get_beatmap(const int id) {
-        if (!load_finished) return nullptr;
-        if (const auto it = index.find(id); it != index.end()) {
-            return &beatmaps[it->second];
+    bool BeatmapLoader::is_idle() const {
+        return idle;
+    }
+
+    BeatmapLoader::BeatmapLoader() : published(std::make_shared<const LibrarySnapshot>(0, std::vector<Beatmap>())) {}
+
+    /**
+     * @brief Intern the part of a path after dir + '/', or the whole path if it is somewhere else
+     *
+     * @return true if the path is in the directory
+     */
+    static bool intern_path(utils::StringArena &strings, const std::string_view dir, const std::string_view path,
+                            utils::StringRef &name) {
+        const bool in_dir = path.size() > dir.size() && path.starts_with(dir) && path[dir.size()] == '/';
+        name = strings.intern(in_dir ? path.substr(dir.size() + 1) : path);
+        return in_dir;
+    }
+
+    LibrarySnapshot::LibrarySnapshot(const uint32_t generation, const std::vector<Beatmap> &beatmaps)
+        : generation(generation) {
+        records.resize(beatmaps.size());
+        index.reserve(beatmaps.size());
+        for (uint32_t i = 0; i < beatmaps.size(); i++) {
+            const auto &beatmap = beatmaps[i];
+            auto &record = records[i];
+            const std::string_view path = beatmap.path;
+            const auto separator = path.rfind('/');
+            const auto dir = separator == std::string_view::npos ? std::string_view() : path.substr(0, separator);
+            record.dir = strings.intern(dir);
+            record.flags = 0;
+            if (intern_path(strings, dir, path, record.file)) record.flags |= PATH_IN_DIR;
+            if (intern_path(strings, dir, beatmap.thumbnail_path, record.thumbnail)) record.flags |= THUMBNAIL_IN_DIR;
+            if (intern_path(strings, dir, beatmap.music_path, record.music)) record.flags |= MUSIC_IN_DIR;
+            record.title = strings.intern(beatmap.title);
+            record.artist = strings.intern(beatmap.artist);
+            record.id = beatmap.id;
+            record.music_id = beatmap.music_id;
+            record.thumbnail_id = beatmap.thumbnail_id;
+            record.single_note_count = beatmap.single_note_count;
+            record.hold_note_count = beatmap.hold_note_count;
+            record.preview_point = beatmap.preview_point;
+            record.star_rating = beatmap.star_rating;
+            record.difficulty = beatmap.difficulty;
+            record.hp_drain = beatmap.hp_drain;
+            if (!index.insert(beatmap.id, i)) logger->warn("Duplicated beatmap ID {}: {}", beatmap.id, beatmap.path);
         }
-        return nullptr;
+        strings.finish();
+        build_sort_indexes();
+        search_index.build(records, strings);
+    }
+
+    Beatmap LibrarySnapshot::get(const uint32_t slot) const {
+        const auto &record = records[slot];
+        const auto join = [this, &record](const utils::StringRef name, const uint8_t flag) {
+            std::string path;
+            if (record.flags & flag) {
+                path = strings.get(record.dir);
+                path += '/';
+            }
+            path += strings.get(name);
+            return path;
+        };
+        Beatmap beatmap;
+        beatmap.id = record.id;
+        beatmap.path = join(record.file, PATH_IN_DIR);
+        beatmap.title = strings.get(record.title);
+        beatmap.artist = strings.get(record.artist);
+        beatmap.thumbnail_path = join(record.thumbnail, THUMBNAIL_IN_DIR);
+        beatmap.music_path = join(record.music, MUSIC_IN_DIR);
+        beatmap.single_note_count = record.single_note_count;
+        beatmap.hold_note_count = record.hold_note_count;
+        beatmap.preview_point = record.preview_point;
+        beatmap.difficulty = record.difficulty;
+        beatmap.hp_drain = record.hp_drain;
+        beatmap.star_rating = record.star_rating;
+        beatmap.music_id = record.music_id;
+        beatmap.thumbnail_id = record.thumbnail_id;
+        return beatmap;
+    }
+
+    const BeatmapRecord* LibrarySnapshot::resolve(BeatmapHandle &handle) const {
+        if (handle.generation != generation) handle = find(handle.id);
+        return handle.valid() ? &records[handle.slot] : nullptr;
+    }
+
+    BeatmapHandle LibrarySnapshot::find(const unsigned id) const {
+        return {id, index.find(id), generation};
+    }
+
+    BeatmapHandle LibrarySnapshot::handle_at(const size_t slot) const {
+        if (slot >= records.size()) return {0, utils::FlatIndex::NOT_FOUND, generation};
+        return {records[slot].id, static_cast<uint32_t>(slot), generation};
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,192 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "data.h"
+#include "logging.h"
+#include "mapped_file.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#define MANIFEST_MAGIC 0x314C4E41 // "ANL1"
+#define MANIFEST_FORMAT_VERSION 4
+// bytes of a file record with empty strings: 5 string lengths, size, mtime, hash, the beatmap numbers and 2 ids
+#define MANIFEST_MIN_FILE_RECORD (5 * 4 + 3 * 8 + 4 * 4 + 2 + 2 + 2 * 8)
+// bytes of a failed file record with an empty name: name length, size, mtime, hash
+#define MANIFEST_MIN_FAILED_RECORD (4 + 3 * 8)
+
+const auto logger = anisette::logging::get("manifest");
+
+namespace anisette::data
+{
+    /*
+     * Library manifest layout, all integers in host byte order:
+     *   u32 magic, u32 version, u32 directory count
+     *   per directory: string path, i64 mtime, u32 file count
+     *     per file: string name, u64 size, i64 mtime, u64 hash,
+     *               u32 id, u32 preview_point, i32 single_note_count, i32 hold_note_count, u8 difficulty, u8 hp_drain,
+     *               u16 star_rating,
+     *               string title, string artist, string thumbnail_path, string music_path, u64 music_id, u64 thumbnail_id
+     *     u32 failed count
+     *     per failed file: string name, u64 size, i64 mtime, u64 hash
+     * Strings are stored as u32 length followed by the bytes.
+     */
+    class ManifestWriter {
+    public:
+        explicit ManifestWriter(std::ofstream &ofs) : ofs(ofs) {}
+
+        template<typename T>
+        void put(const T value) {
+            ofs.write(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        void put(const std::string &str) {
+            put(static_cast<uint32_t>(str.size()));
+            ofs.write(str.data(), static_cast<std::streamsize>(str.size()));
+        }
+
+    private:
+        std::ofstream &ofs;
+    };
+
+    class ManifestReader {
+    public:
+        ManifestReader(const char *data, const size_t size) : cursor(data), end(data + size) {}
+
+        template<typename T>
+        bool get(T &value) {
+            if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+            memcpy(&value, cursor, sizeof(T));
+            cursor += sizeof(T);
+            return true;
+        }
+
+        bool get(std::string &str) {
+            uint32_t length = 0;
+            if (!get(length) || static_cast<size_t>(end - cursor) < length) return false;
+            str.assign(cursor, length);
+            cursor += length;
+            return true;
+        }
+
+        [[nodiscard]] size_t remaining() const {
+            return static_cast<size_t>(end - cursor);
+        }
+
+    private:
+        const char *cursor;
+        const char *end;
+    };
+
+    bool load_manifest(const std::string &path, Manifest &manifest) {
+        manifest.clear();
+        const MappedFile file(path);
+        if (!file.is_open()) return false;
+        ManifestReader reader(file.data(), file.size());
+        uint32_t magic = 0, version = 0, directory_count = 0;
+        if (!reader.get(magic) || !reader.get(version) || !reader.get(directory_count)) return false;
+        if (magic != MANIFEST_MAGIC || version != MANIFEST_FORMAT_VERSION) {
+            logger->info("Library manifest is outdated, rebuilding");
+            return false;
+        }
+        for (uint32_t i = 0; i < directory_count; i++) {
+            std::string dir;
+            ManifestDirectory directory;
+            uint32_t file_count = 0;
+            if (!reader.get(dir) || !reader.get(directory.mtime) || !reader.get(file_count)) goto corrupted;
+            // the count is checked against the data left before allocating for it
+            if (file_count > reader.remaining() / MANIFEST_MIN_FILE_RECORD) goto corrupted;
+            directory.files.resize(file_count);
+            for (auto &[name, stamp, beatmap] : directory.files) {
+                bool ok = reader.get(name) && reader.get(stamp.size) && reader.get(stamp.mtime) && reader.get(stamp.hash)
+                    && reader.get(beatmap.id) && reader.get(beatmap.preview_point)
+                    && reader.get(beatmap.single_note_count) && reader.get(beatmap.hold_note_count)
+                    && reader.get(beatmap.difficulty) && reader.get(beatmap.hp_drain) && reader.get(beatmap.star_rating)
+                    && reader.get(beatmap.title) && reader.get(beatmap.artist)
+                    && reader.get(beatmap.thumbnail_path) && reader.get(beatmap.music_path)
+                    && reader.get(beatmap.music_id) && reader.get(beatmap.thumbnail_id);
+                if (!ok) goto corrupted;
+                beatmap.path = dir + '/' + name;
+            }
+            uint32_t failed_count = 0;
+            if (!reader.get(failed_count) || failed_count > reader.remaining() / MANIFEST_MIN_FAILED_RECORD) {
+                goto corrupted;
+            }
+            directory.failed.resize(failed_count);
+            for (auto &[name, stamp] : directory.failed) {
+                const bool ok = reader.get(name) && reader.get(stamp.size) && reader.get(stamp.mtime)
+                    && reader.get(stamp.hash);
+                if (!ok) goto corrupted;
+            }
+            manifest.emplace(std::move(dir), std::move(directory));
+        }
+        logger->debug("Loaded library manifest with {} directories", manifest.size());
+        return true;
+
+        corrupted:
+        logger->warn("Library manifest is corrupted, rebuilding");
+        manifest.clear();
+        return false;
+    }
+
+    bool save_manifest(const std::string &path, const Manifest &manifest) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        const auto temp_path = path + ".tmp";
+        {
+            std::ofstream ofs(temp_path, std::ios::binary | std::ios::trunc);
+            if (!ofs.is_open()) {
+                logger->error("Failed to open library manifest for writing: {}", temp_path);
+                return false;
+            }
+            ManifestWriter writer(ofs);
+            writer.put<uint32_t>(MANIFEST_MAGIC);
+            writer.put<uint32_t>(MANIFEST_FORMAT_VERSION);
+            writer.put(static_cast<uint32_t>(manifest.size()));
+            for (const auto &[dir, directory] : manifest) {
+                writer.put(dir);
+                writer.put(directory.mtime);
+                writer.put(static_cast<uint32_t>(directory.files.size()));
+                for (const auto &[name, stamp, beatmap] : directory.files) {
+                    writer.put(name);
+                    writer.put(stamp.size);
+                    writer.put(stamp.mtime);
+                    writer.put(stamp.hash);
+                    writer.put(beatmap.id);
+                    writer.put(beatmap.preview_point);
+                    writer.put(beatmap.single_note_count);
+                    writer.put(beatmap.hold_note_count);
+                    writer.put(beatmap.difficulty);
+                    writer.put(beatmap.hp_drain);
+                    writer.put(beatmap.star_rating);
+                    writer.put(beatmap.title);
+                    writer.put(beatmap.artist);
+                    writer.put(beatmap.thumbnail_path);
+                    writer.put(beatmap.music_path);
+                    writer.put(beatmap.music_id);
+                    writer.put(beatmap.thumbnail_id);
+                }
+                writer.put(static_cast<uint32_t>(directory.failed.size()));
+                for (const auto &[name, stamp] : directory.failed) {
+                    writer.put(name);
+                    writer.put(stamp.size);
+                    writer.put(stamp.mtime);
+                    writer.put(stamp.hash);
+                }
+            }
+            if (!ofs.good()) {
+                logger->error("Failed to write library manifest: {}", temp_path);
+                ofs.close();
+                std::filesystem::remove(temp_path, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(temp_path, path, ec);
+        if (ec) {
+            logger->error("Failed to commit library manifest {}: {}", path, ec.message());
+            std::filesystem::remove(temp_path, ec);
+            return false;
+        }
+        return true;
+    }
+}
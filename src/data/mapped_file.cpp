@@ -0,0 +1,110 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "mapped_file.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace anisette::data
+{
+    MappedFile::MappedFile(MappedFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this == &other) return *this;
+        close();
+        address = std::exchange(other.address, nullptr);
+        length = std::exchange(other.length, 0);
+        opened = std::exchange(other.opened, false);
+#ifdef _WIN32
+        file_handle = std::exchange(other.file_handle, nullptr);
+        mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#endif
+        return *this;
+    }
+
+#ifdef _WIN32
+    bool MappedFile::open(const std::string &path) {
+        close();
+        const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size)) {
+            CloseHandle(file);
+            return false;
+        }
+        file_handle = file;
+        length = static_cast<size_t>(file_size.QuadPart);
+        opened = true;
+        if (length == 0) return true;
+        mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_handle) {
+            close();
+            return false;
+        }
+        address = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (!address) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address) UnmapViewOfFile(address);
+        if (mapping_handle) CloseHandle(mapping_handle);
+        if (file_handle) CloseHandle(file_handle);
+        address = nullptr;
+        mapping_handle = nullptr;
+        file_handle = nullptr;
+        length = 0;
+        opened = false;
+    }
+#else
+    bool MappedFile::open(const std::string &path) {
+        close();
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st {};
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(st.st_size);
+        opened = true;
+        if (length == 0) {
+            ::close(fd);
+            return true;
+        }
+        void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            length = 0;
+            opened = false;
+            return false;
+        }
+        address = mapped;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address) munmap(address, length);
+        address = nullptr;
+        length = 0;
+        opened = false;
+    }
+#endif
+}
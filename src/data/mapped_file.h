@@ -0,0 +1,42 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace anisette::data {
+    /**
+     * @brief Read-only memory mapping of a whole file
+     *
+     * The mapping is released when the object is destroyed. Empty files are opened successfully with a null data pointer.
+     */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string &path) { open(path); }
+        ~MappedFile() { close(); }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        MappedFile(MappedFile &&other) noexcept;
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        bool open(const std::string &path);
+        void close();
+
+        [[nodiscard]] bool is_open() const { return opened; }
+        [[nodiscard]] const char *data() const { return static_cast<const char *>(address); }
+        [[nodiscard]] size_t size() const { return length; }
+
+    private:
+        void *address = nullptr;
+        size_t length = 0;
+        bool opened = false;
+#ifdef _WIN32
+        void *file_handle = nullptr;
+        void *mapping_handle = nullptr;
+#endif
+    };
+}
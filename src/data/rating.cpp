@@ -0,0 +1,124 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "data.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// strain is collected in bins, a section is two neighbour bins, so sections overlap by half
+#define STRAIN_BIN_MS 200
+#define STRAIN_SECTION_BINS 2
+// a 7 hour chart, longer ones are clamped into the last bin instead of allocating more
+#define MAX_STRAIN_BINS (1 << 17)
+// gaps shorter than this are not humanly hittable, they count as this gap
+#define MIN_JACK_GAP_MS 40
+#define CHORD_TOLERANCE_MS 10
+#define JACK_WEIGHT 0.25f
+#define CHORD_WEIGHT 0.5f
+#define HOLD_WEIGHT 0.15f
+// hardest sections dominate: the k-th hardest section weighs SECTION_DECAY^k, the rest are ignored
+#define SECTION_DECAY 0.9f
+#define WEIGHTED_SECTIONS 64
+#define STAR_SCALE 0.55f
+#define STAR_EXPONENT 0.8f
+
+namespace anisette::data
+{
+    static uint32_t to_bin(const int32_t time) {
+        return static_cast<uint32_t>(std::clamp(time / STRAIN_BIN_MS, 0, MAX_STRAIN_BINS - 1));
+    }
+
+    /*
+     * Every pass below is a straight loop over one column with no branch in its body, so the compiler turns them
+     * into SIMD code; only the scatter into bins is scalar, and it is a single add per note.
+     */
+    uint16_t rate_chart(const NoteChart &chart) {
+        const uint32_t count = chart.size();
+        if (count == 0) return 0;
+        const int32_t *start = chart.start.data();
+        const int32_t *end = chart.end.data();
+
+        // release time of every note: the end of a hold, the start of a single note (end is 0 there)
+        std::vector<int32_t> release(count);
+        int32_t last = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            release[i] = std::max(start[i], end[i]);
+            last = std::max(last, release[i]);
+        }
+        const uint32_t bins = to_bin(last) + 1;
+
+        // jack strain: how fast the same finger has to hit again, in hits per second
+        std::vector<float> jack(count);
+        for (int c = 0; c < 6; c++) {
+            const uint32_t begin = chart.channel_begin[c], channel_end = chart.channel_begin[c + 1];
+            if (begin == channel_end) continue;
+            jack[begin] = 0;
+            for (uint32_t i = begin + 1; i < channel_end; i++) {
+                const int32_t gap = std::max(start[i] - release[i - 1], MIN_JACK_GAP_MS);
+                jack[i] = 1000.0f / static_cast<float>(gap);
+            }
+        }
+
+        // chords: notes starting together with the previous note of the timeline
+        std::vector<int32_t> ordered(count);
+        for (uint32_t i = 0; i < count; i++) ordered[i] = start[chart.timeline[i]];
+        std::vector<float> chord(count);
+        chord[0] = 0;
+        for (uint32_t i = 1; i < count; i++) {
+            chord[i] = static_cast<float>(ordered[i] - ordered[i - 1] <= CHORD_TOLERANCE_MS);
+        }
+
+        // per bin sums; hold coverage is added as a difference array over the bins fully inside a hold
+        std::vector<float> density(bins), jack_sum(bins), chord_sum(bins), hold(bins), covered(bins + 1);
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t bin = to_bin(start[i]);
+            density[bin] += 1;
+            jack_sum[bin] += jack[i];
+            chord_sum[to_bin(ordered[i])] += chord[i];
+            if (end[i] == 0) continue;
+            const uint32_t last_bin = to_bin(release[i]);
+            if (bin == last_bin) {
+                hold[bin] += static_cast<float>(release[i] - start[i]);
+                continue;
+            }
+            hold[bin] += static_cast<float>(std::min(static_cast<int32_t>(bin + 1) * STRAIN_BIN_MS - start[i], STRAIN_BIN_MS));
+            hold[last_bin] += static_cast<float>(std::min(release[i] - static_cast<int32_t>(last_bin) * STRAIN_BIN_MS,
+                                                          STRAIN_BIN_MS));
+            covered[bin + 1] += STRAIN_BIN_MS;
+            covered[last_bin] -= STRAIN_BIN_MS;
+        }
+        float running = 0;
+        for (uint32_t b = 0; b < bins; b++) {
+            running += covered[b];
+            hold[b] += running;
+        }
+
+        // strain of every bin, in weighted notes per second
+        constexpr float per_second = 1000.0f / STRAIN_BIN_MS;
+        std::vector<float> strain(bins);
+        for (uint32_t b = 0; b < bins; b++) {
+            strain[b] = per_second * (density[b] + JACK_WEIGHT * jack_sum[b] / std::max(density[b], 1.0f)
+                + CHORD_WEIGHT * chord_sum[b] + HOLD_WEIGHT * hold[b] / STRAIN_BIN_MS);
+        }
+
+        // overlapping sections, then a decaying weighted mean of the hardest ones
+        const uint32_t sections = bins > STRAIN_SECTION_BINS ? bins - STRAIN_SECTION_BINS + 1 : 1;
+        std::vector<float> section(sections);
+        for (uint32_t s = 0; s < sections; s++) {
+            float sum = 0;
+            for (uint32_t k = 0; k < STRAIN_SECTION_BINS && s + k < bins; k++) sum += strain[s + k];
+            section[s] = sum / STRAIN_SECTION_BINS;
+        }
+        const auto weighted_end = section.begin() + std::min<ptrdiff_t>(WEIGHTED_SECTIONS, sections);
+        std::partial_sort(section.begin(), weighted_end, section.end(), std::greater());
+        float weighted = 0, total_weight = 0, weight = 1;
+        for (auto it = section.begin(); it != weighted_end; ++it) {
+            weighted += *it * weight;
+            total_weight += weight;
+            weight *= SECTION_DECAY;
+        }
+        const float stars = STAR_SCALE * std::pow(weighted / total_weight, STAR_EXPONENT);
+        return static_cast<uint16_t>(std::clamp(std::lround(stars * 100), 0L, 65535L));
+    }
+}
@@ -0,0 +1,197 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "data.h"
+#include <algorithm>
+#include <iterator>
+
+#define SEARCH_MAX_TERMS 8
+// padding byte of word prefix grams, never part of normalized text
+#define WORD_START '\x01'
+// below 1/64 of the library the candidates are sorted, above that the sort order is walked
+#define SEARCH_SORT_THRESHOLD 64
+
+namespace anisette::data
+{
+    // score of a single term, the record score is the sum over all terms
+    enum MatchScore {
+        TITLE_PREFIX = 0,
+        TITLE_WORD_START = 1,
+        TITLE_SUBSTRING = 2,
+        ARTIST_WORD_START = 3,
+        ARTIST_SUBSTRING = 4
+    };
+
+    // lowercase ASCII, control characters become spaces so they never collide with the padding and separators
+    static char normalize(const char c) {
+        if (static_cast<unsigned char>(c) < 0x20) return ' ';
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    static uint32_t pack_trigram(const char a, const char b, const char c) {
+        return static_cast<uint32_t>(static_cast<unsigned char>(a)) << 16
+             | static_cast<uint32_t>(static_cast<unsigned char>(b)) << 8
+             | static_cast<uint32_t>(static_cast<unsigned char>(c));
+    }
+
+    static uint32_t pack_trigram(const char *str) {
+        return pack_trigram(str[0], str[1], str[2]);
+    }
+
+    static bool is_separator(const char c) {
+        return c == ' ' || c == '\n';
+    }
+
+    void SearchIndex::build(const std::vector<BeatmapRecord> &records, const utils::StringArena &strings) {
+        text.clear();
+        text_offsets.assign(1, 0);
+        title_lengths.clear();
+        for (const auto &record : records) {
+            for (const char c : strings.get(record.title)) text.push_back(normalize(c));
+            text.push_back('\n');
+            for (const char c : strings.get(record.artist)) text.push_back(normalize(c));
+            title_lengths.push_back(record.title.length);
+            text_offsets.push_back(static_cast<uint32_t>(text.size()));
+        }
+
+        // (trigram, slot) pairs, sorted and deduplicated they become the posting lists
+        std::vector<uint64_t> pairs;
+        pairs.reserve(text.size());
+        for (uint32_t slot = 0; slot < records.size(); slot++) {
+            const auto begin = text_offsets[slot], end = text_offsets[slot + 1];
+            for (uint32_t i = begin; i < end; i++) {
+                if (text[i] == '\n') continue;
+                // word starts also get padded grams, so terms shorter than a trigram are indexed as word prefixes
+                if ((i == begin || is_separator(text[i - 1])) && !is_separator(text[i])) {
+                    pairs.push_back(static_cast<uint64_t>(pack_trigram(WORD_START, WORD_START, text[i])) << 32 | slot);
+                    if (i + 1 < end && text[i + 1] != '\n') {
+                        pairs.push_back(static_cast<uint64_t>(pack_trigram(WORD_START, text[i], text[i + 1])) << 32 | slot);
+                    }
+                }
+                if (i + 3 > end || text[i + 1] == '\n' || text[i + 2] == '\n') continue;
+                pairs.push_back(static_cast<uint64_t>(pack_trigram(&text[i])) << 32 | slot);
+            }
+        }
+        std::ranges::sort(pairs);
+        const auto [first, last] = std::ranges::unique(pairs);
+        pairs.erase(first, last);
+
+        trigrams.clear();
+        posting_offsets.clear();
+        postings.resize(pairs.size());
+        for (size_t i = 0; i < pairs.size(); i++) {
+            const auto trigram = static_cast<uint32_t>(pairs[i] >> 32);
+            if (i == 0 || trigram != static_cast<uint32_t>(pairs[i - 1] >> 32)) {
+                trigrams.insert(trigram, static_cast<uint32_t>(posting_offsets.size()));
+                posting_offsets.push_back(static_cast<uint32_t>(i));
+            }
+            postings[i] = static_cast<uint32_t>(pairs[i]);
+        }
+        posting_offsets.push_back(static_cast<uint32_t>(postings.size()));
+    }
+
+    std::vector<std::string> SearchIndex::split_query(const std::string_view query) {
+        std::vector<std::string> terms;
+        std::string term;
+        for (const char c : query) {
+            if (normalize(c) == ' ') {
+                if (!term.empty()) terms.push_back(std::move(term));
+                term.clear();
+            } else {
+                term.push_back(normalize(c));
+            }
+        }
+        if (!term.empty()) terms.push_back(std::move(term));
+        if (terms.size() > SEARCH_MAX_TERMS) terms.resize(SEARCH_MAX_TERMS);
+        return terms;
+    }
+
+    void SearchIndex::collect_candidates(const std::vector<std::string> &terms, std::vector<uint32_t> &candidates) const {
+        // posting lists of every trigram of every term, the candidates are their intersection
+        std::vector<std::pair<const uint32_t *, const uint32_t *>> lists;
+        std::vector<uint32_t> keys;
+        for (const auto &term : terms) {
+            if (term.size() == 1) keys.push_back(pack_trigram(WORD_START, WORD_START, term[0]));
+            else if (term.size() == 2) keys.push_back(pack_trigram(WORD_START, term[0], term[1]));
+            else for (size_t i = 0; i + 3 <= term.size(); i++) keys.push_back(pack_trigram(&term[i]));
+        }
+        for (const auto key : keys) {
+            const auto list = trigrams.find(key);
+            if (list == utils::FlatIndex::NOT_FOUND) {
+                candidates.clear();
+                return;
+            }
+            lists.emplace_back(postings.data() + posting_offsets[list], postings.data() + posting_offsets[list + 1]);
+        }
+        if (lists.empty()) {
+            candidates.clear();
+            return;
+        }
+        // start from the shortest list, so the intersection only shrinks
+        std::ranges::sort(lists, {}, [](const auto &list) { return list.second - list.first; });
+        candidates.assign(lists[0].first, lists[0].second);
+        std::vector<uint32_t> next;
+        for (size_t i = 1; i < lists.size() && !candidates.empty(); i++) {
+            next.clear();
+            std::set_intersection(candidates.begin(), candidates.end(), lists[i].first, lists[i].second,
+                                  std::back_inserter(next));
+            candidates.swap(next);
+        }
+    }
+
+    int SearchIndex::score(const uint32_t slot, const std::vector<std::string> &terms) const {
+        const std::string_view record(text.data() + text_offsets[slot], text_offsets[slot + 1] - text_offsets[slot]);
+        const auto title_length = title_lengths[slot];
+        int total = 0;
+        for (const auto &term : terms) {
+            int best = -1;
+            for (size_t pos = record.find(term); pos != std::string_view::npos; pos = record.find(term, pos + 1)) {
+                const bool word_start = pos == 0 || is_separator(record[pos - 1]);
+                // short terms only match word prefixes, like the index
+                if (term.size() < 3 && !word_start) continue;
+                int current;
+                if (pos < title_length) current = pos == 0 ? TITLE_PREFIX : word_start ? TITLE_WORD_START : TITLE_SUBSTRING;
+                else current = word_start ? ARTIST_WORD_START : ARTIST_SUBSTRING;
+                if (best < 0 || current < best) best = current;
+                // occurrences come in order, later ones can only beat the current best by a word start in the title
+                if (best <= TITLE_WORD_START || (pos >= title_length && best <= ARTIST_WORD_START)) break;
+            }
+            if (best < 0) return -1;
+            total += best;
+        }
+        return total;
+    }
+
+    std::vector<uint32_t> LibrarySnapshot::search(const std::string_view query, const SortStrategy strategy,
+                                                  const bool ascending) const {
+        std::vector<uint32_t> result;
+        const auto terms = SearchIndex::split_query(query);
+        if (terms.empty()) return result;
+        // candidates in the current sort order, bucketed by score below keeps that order for equal scores
+        std::vector<uint32_t> candidates;
+        search_index.collect_candidates(terms, candidates);
+        if (candidates.size() * SEARCH_SORT_THRESHOLD < records.size()) {
+            // few candidates, sort them by position
+            std::vector<uint64_t> keyed(candidates.size());
+            for (size_t i = 0; i < candidates.size(); i++) {
+                keyed[i] = static_cast<uint64_t>(position_of(strategy, ascending, candidates[i])) << 32 | candidates[i];
+            }
+            std::ranges::sort(keyed);
+            for (size_t i = 0; i < keyed.size(); i++) candidates[i] = static_cast<uint32_t>(keyed[i]);
+        } else {
+            // many candidates, mark them and walk the sort order once instead
+            std::vector<bool> marked(records.size());
+            for (const auto slot : candidates) marked[slot] = true;
+            candidates.clear();
+            for (size_t i = 0; i < records.size(); i++) {
+                if (const auto slot = slot_at(strategy, ascending, i); marked[slot]) candidates.push_back(slot);
+            }
+        }
+        std::vector<std::vector<uint32_t>> buckets(terms.size() * ARTIST_SUBSTRING + 1);
+        for (const auto slot : candidates) {
+            if (const int score = search_index.score(slot, terms); score >= 0) buckets[score].push_back(slot);
+        }
+        for (const auto &bucket : buckets) result.insert(result.end(), bucket.begin(), bucket.end());
+        return result;
+    }
+}
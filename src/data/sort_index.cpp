@@ -0,0 +1,104 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "data.h"
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+
+namespace anisette::data
+{
+    // compact sort key of one beatmap, strings are replaced by their rank so every order sorts integers only
+    struct SortKey {
+        uint32_t title_rank;
+        uint32_t artist_rank;
+        unsigned id;
+        uint8_t difficulty;
+        uint16_t star_rating;
+    };
+
+    /**
+     * @brief Dense rank of an interned string field, equal strings share a rank
+     *
+     * Interned strings share their offset, so only the distinct strings are sorted, not every record.
+     * The empty string has rank 0 and never takes part in the sort, its offset may be shared with another string.
+     */
+    static void rank_strings(const std::vector<BeatmapRecord> &records, const utils::StringArena &strings,
+                             std::vector<SortKey> &keys, uint32_t SortKey::*rank, utils::StringRef BeatmapRecord::*field) {
+        std::vector<utils::StringRef> distinct;
+        distinct.reserve(records.size());
+        for (const auto &record : records) {
+            if ((record.*field).length > 0) distinct.push_back(record.*field);
+        }
+        const auto by_offset = [](const utils::StringRef a, const utils::StringRef b) { return a.offset < b.offset; };
+        std::ranges::sort(distinct, by_offset);
+        const auto [first, last] = std::ranges::unique(distinct, {}, &utils::StringRef::offset);
+        distinct.erase(first, last);
+        std::ranges::sort(distinct, [&strings](const utils::StringRef a, const utils::StringRef b) {
+            return strings.get(a) < strings.get(b);
+        });
+        utils::FlatIndex ranks;
+        ranks.reserve(distinct.size());
+        uint32_t current = 0;
+        for (size_t i = 0; i < distinct.size(); i++) {
+            // a hash collision in the arena may leave a duplicate behind, it still gets the same rank
+            if (i == 0 || strings.get(distinct[i - 1]) != strings.get(distinct[i])) current++;
+            ranks.insert(distinct[i].offset, current);
+        }
+        for (size_t i = 0; i < records.size(); i++) {
+            const auto ref = records[i].*field;
+            keys[i].*rank = ref.length > 0 ? ranks.find(ref.offset) : 0;
+        }
+    }
+
+    void LibrarySnapshot::build_sort_indexes() {
+        std::vector<SortKey> keys(records.size());
+        for (size_t i = 0; i < records.size(); i++) {
+            keys[i].id = records[i].id;
+            keys[i].difficulty = records[i].difficulty;
+            keys[i].star_rating = records[i].star_rating;
+        }
+        rank_strings(records, strings, keys, &SortKey::title_rank, &BeatmapRecord::title);
+        rank_strings(records, strings, keys, &SortKey::artist_rank, &BeatmapRecord::artist);
+
+        // tie-breakers end with the slot, so every order is total and stable between runs
+        for (int strategy = 0; strategy < NONE; strategy++) {
+            auto &order = orders[strategy];
+            order.resize(records.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::ranges::sort(order, [&keys, strategy](const uint32_t a, const uint32_t b) {
+                const auto &x = keys[a], &y = keys[b];
+                switch (strategy) {
+                    case BY_ID:
+                        return std::tie(x.id, a) < std::tie(y.id, b);
+                    case BY_TITLE:
+                        return std::tie(x.title_rank, x.artist_rank, x.id, a) < std::tie(y.title_rank, y.artist_rank, y.id, b);
+                    case BY_ARTIST:
+                        return std::tie(x.artist_rank, x.title_rank, x.id, a) < std::tie(y.artist_rank, y.title_rank, y.id, b);
+                    case BY_DIFFICULTY:
+                        return std::tie(x.difficulty, x.title_rank, x.id, a) < std::tie(y.difficulty, y.title_rank, y.id, b);
+                    case BY_STAR_RATING:
+                        return std::tie(x.star_rating, x.title_rank, x.id, a) < std::tie(y.star_rating, y.title_rank, y.id, b);
+                    default:
+                        return a < b;
+                }
+            });
+            auto &position = positions[strategy];
+            position.resize(records.size());
+            for (uint32_t i = 0; i < order.size(); i++) position[order[i]] = i;
+        }
+    }
+
+    uint32_t LibrarySnapshot::slot_at(const SortStrategy strategy, const bool ascending, const size_t position) const {
+        if (position >= records.size()) return utils::FlatIndex::NOT_FOUND;
+        const size_t index = ascending ? position : records.size() - 1 - position;
+        if (strategy >= NONE) return static_cast<uint32_t>(index);
+        return orders[strategy][index];
+    }
+
+    size_t LibrarySnapshot::position_of(const SortStrategy strategy, const bool ascending, const uint32_t slot) const {
+        if (slot >= records.size()) return 0;
+        const size_t index = strategy >= NONE ? slot : positions[strategy][slot];
+        return ascending ? index : records.size() - 1 - index;
+    }
+}
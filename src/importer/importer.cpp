@@ -0,0 +1,193 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "importer.h"
+#include "hash.h"
+#include "logging.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#define SCHEMA_VERSION 1
+#define SCHEMA_URL "https://raw.githubusercontent.com/im-yuuki/AnisetteProject/refs/heads/sdl2/scripts/beatmap.schema.json"
+
+const auto logger = anisette::logging::get("import");
+
+namespace anisette::importer
+{
+    static bool ends_with_ignore_case(const std::string_view str, const std::string_view suffix) {
+        if (str.size() < suffix.size()) return false;
+        for (size_t i = 0; i < suffix.size(); i++) {
+            if (std::tolower(static_cast<unsigned char>(str[str.size() - suffix.size() + i])) != suffix[i]) return false;
+        }
+        return true;
+    }
+
+    static std::string to_json(const data::Beatmap &beatmap, const data::NoteChart &chart) {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        writer.StartObject();
+        writer.Key("$schema");
+        writer.String(SCHEMA_URL);
+        writer.Key("version");
+        writer.Int(SCHEMA_VERSION);
+        writer.Key("id");
+        writer.Uint(beatmap.id);
+        writer.Key("title");
+        writer.String(beatmap.title.c_str(), static_cast<rapidjson::SizeType>(beatmap.title.size()));
+        writer.Key("artist");
+        writer.String(beatmap.artist.c_str(), static_cast<rapidjson::SizeType>(beatmap.artist.size()));
+        writer.Key("thumbnail");
+        writer.String(beatmap.thumbnail_path.c_str(), static_cast<rapidjson::SizeType>(beatmap.thumbnail_path.size()));
+        writer.Key("music");
+        writer.String(beatmap.music_path.c_str(), static_cast<rapidjson::SizeType>(beatmap.music_path.size()));
+        writer.Key("preview_point");
+        writer.Uint(beatmap.preview_point);
+        writer.Key("difficulty");
+        writer.Uint(beatmap.difficulty);
+        writer.Key("hp_drain");
+        writer.Uint(beatmap.hp_drain);
+        writer.Key("notes");
+        writer.StartObject();
+        writer.Key("single_note_count");
+        writer.Int(beatmap.single_note_count);
+        writer.Key("hold_note_count");
+        writer.Int(beatmap.hold_note_count);
+        for (int c = 0; c < 6; c++) {
+            const std::string key = "channel_" + std::to_string(c);
+            writer.Key(key.c_str());
+            writer.StartArray();
+            for (auto i = chart.channel_begin[c]; i < chart.channel_begin[c + 1]; i++) {
+                writer.StartArray();
+                writer.Int(chart.start[i]);
+                writer.Int(chart.end[i]);
+                writer.EndArray();
+            }
+            writer.EndArray();
+        }
+        writer.EndObject();
+        writer.EndObject();
+        return {buffer.GetString(), buffer.GetSize()};
+    }
+
+    static bool write_file(const std::filesystem::path &path, const std::string &content) {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        ofs.write(content.data(), static_cast<std::streamsize>(content.size()));
+        return ofs.good();
+    }
+
+    /**
+     * @brief Copy a file referenced by a beatmap out of the archive, once per set
+     */
+    static void copy_asset(const ZipArchive &archive, const std::string &name, const std::filesystem::path &dir,
+                           std::set<std::string> &copied, std::string &buffer) {
+        if (name.empty() || copied.contains(name)) return;
+        copied.insert(name);
+        // never let an archive write outside its set directory
+        const std::filesystem::path relative(name);
+        if (relative.is_absolute() || relative.has_root_name() || std::ranges::find(relative, "..") != relative.end()) {
+            logger->warn("Refused to extract {}: path leaves the set directory", name);
+            return;
+        }
+        const auto entry = archive.find(name);
+        if (!entry) {
+            logger->warn("File {} is referenced but not found in the archive", name);
+            return;
+        }
+        if (!archive.extract(*entry, buffer)) {
+            logger->warn("Failed to extract {}: {}", name, archive.get_error());
+            return;
+        }
+        const auto target = dir / name;
+        std::error_code ec;
+        std::filesystem::create_directories(target.parent_path(), ec);
+        if (!write_file(target, buffer)) logger->warn("Failed to write {}", target.string());
+    }
+
+    /**
+     * @brief Import every osu!mania difficulty of one archive into its own set directory
+     *
+     * @return false if the archive itself could not be read
+     */
+    static bool import_archive(const std::string &archive_path, const ImportOptions &options,
+                               std::atomic_uint &imported, std::atomic_uint &skipped) {
+        ZipArchive archive;
+        if (!archive.open(archive_path)) {
+            logger->error("Failed to open archive {}: {}", archive_path, archive.get_error());
+            return false;
+        }
+        const auto stem = std::filesystem::path(archive_path).stem().string();
+        // same composition as the library scan, so the cache paths match
+        const auto dir = (std::filesystem::path(options.output_dir) / stem).string();
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) {
+            logger->error("Failed to create directory {}: {}", dir, ec.message());
+            return false;
+        }
+
+        std::set<std::string> copied;
+        std::string text, buffer;
+        ConvertedBeatmap converted;
+        for (const auto &entry : archive.get_entries()) {
+            if (!ends_with_ignore_case(entry.name, ".osu")) continue;
+            if (!archive.extract(entry, text)) {
+                logger->warn("Failed to extract {} from {}: {}", entry.name, archive_path, archive.get_error());
+                ++skipped;
+                continue;
+            }
+            // unsubmitted maps have no ID, derive a stable one from the archive and difficulty name
+            const auto fallback_id = static_cast<unsigned>(utils::fnv1a64(entry.name, utils::fnv1a64(stem)) & 0x7FFFFFFF);
+            std::string error;
+            if (!convert_osu(text, fallback_id, converted, error)) {
+                logger->debug("Skipped {} in {}: {}", entry.name, archive_path, error);
+                ++skipped;
+                continue;
+            }
+            auto &beatmap = converted.beatmap;
+            const auto json = to_json(beatmap, converted.chart);
+            const auto source = std::filesystem::path(dir) / (std::to_string(beatmap.id) + ".json");
+            if (!write_file(source, json)) {
+                logger->error("Failed to write {}", source.string());
+                ++skipped;
+                continue;
+            }
+            copy_asset(archive, beatmap.thumbnail_path, dir, copied, buffer);
+            copy_asset(archive, beatmap.music_path, dir, copied, buffer);
+
+            if (options.write_cache) {
+                // compile straight from memory, the paths must look like what the JSON parser produces
+                data::SourceStamp stamp;
+                if (data::read_source_stamp(source.string(), stamp)) {
+                    stamp.hash = utils::fnv1a64(json.data(), json.size());
+                    beatmap.thumbnail_path = dir + '/' + beatmap.thumbnail_path;
+                    beatmap.music_path = dir + '/' + beatmap.music_path;
+                    beatmap.save_cache(data::get_cache_path(source.string()), stamp, converted.chart);
+                }
+            }
+            ++imported;
+        }
+        return true;
+    }
+
+    ImportResult import_archives(const std::vector<std::string> &archives, const ImportOptions &options) {
+        std::atomic_uint imported = 0, skipped = 0, failed = 0;
+        utils::parallel_for(archives.size(), options.workers, [&](const size_t i) {
+            if (!import_archive(archives[i], options, imported, skipped)) ++failed;
+        });
+        ImportResult result;
+        result.archives = static_cast<unsigned>(archives.size());
+        result.failed_archives = failed;
+        result.beatmaps = imported;
+        result.skipped_beatmaps = skipped;
+        logger->info("Imported {} beatmaps from {} archives ({} archives failed, {} difficulties skipped)",
+                     result.beatmaps, result.archives, result.failed_archives, result.skipped_beatmaps);
+        return result;
+    }
+} // namespace anisette::importer
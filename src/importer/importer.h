@@ -0,0 +1,104 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include "data.h"
+#include "mapped_file.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace anisette::importer
+{
+    // one file stored in a zip archive
+    struct ZipEntry {
+        std::string name;
+        uint16_t method = 0;
+        uint32_t crc = 0;
+        uint32_t compressed_size = 0;
+        uint32_t size = 0;
+        uint32_t header_offset = 0;
+    };
+
+    /**
+     * @brief Read-only zip archive, mapped in memory and decompressed entry by entry
+     *
+     * Only stored and deflated entries of non-split, non-zip64 archives are supported, which covers .osz packs.
+     */
+    class ZipArchive {
+    public:
+        /**
+         * @brief Map the archive and read its central directory
+         */
+        bool open(const std::string &path);
+
+        /**
+         * @brief Find an entry by name, falls back to a case-insensitive match like the osu! client on Windows
+         *
+         * @return null if no entry matches
+         */
+        [[nodiscard]] const ZipEntry *find(std::string_view name) const;
+
+        /**
+         * @brief Decompress an entry and check its CRC
+         */
+        bool extract(const ZipEntry &entry, std::string &out) const;
+
+        [[nodiscard]] const std::vector<ZipEntry> &get_entries() const { return entries; }
+        [[nodiscard]] const std::string &get_error() const { return error; }
+
+    private:
+        bool fail(const std::string &message) const;
+
+        data::MappedFile file;
+        std::vector<ZipEntry> entries;
+        mutable std::string error;
+    };
+
+    /**
+     * @brief A beatmap converted from an osu!mania difficulty
+     *
+     * The thumbnail and music paths of the beatmap are the file names inside the archive.
+     */
+    struct ConvertedBeatmap {
+        data::Beatmap beatmap;
+        data::NoteChart chart;
+    };
+
+    /**
+     * @brief Convert the text of an .osu file
+     *
+     * 4K, 5K and 6K columns are mapped onto the 6 channels with the same rules as the old Python importer: 4K splits
+     * its outer columns randomly over the two outer channels on each side, 5K splits its middle column over the
+     * two middle channels and 6K keeps its layout. The random split is seeded by the beatmap ID, so importing the
+     * same pack twice gives the same charts.
+     *
+     * @param text Content of the .osu file
+     * @param fallback_id ID used when the file has no BeatmapID, e.g. unsubmitted maps
+     * @param result Converted beatmap
+     * @param error Reason of the failure
+     */
+    bool convert_osu(std::string_view text, unsigned fallback_id, ConvertedBeatmap &result, std::string &error);
+
+    struct ImportOptions {
+        std::string output_dir = "beatmaps";
+        // also write the compiled binary cache, so the first library scan never parses the new maps
+        bool write_cache = true;
+        // 0 means use all hardware threads
+        unsigned workers = 0;
+    };
+
+    struct ImportResult {
+        unsigned archives = 0;
+        unsigned failed_archives = 0;
+        unsigned beatmaps = 0;
+        unsigned skipped_beatmaps = 0;
+    };
+
+    /**
+     * @brief Import .osz archives into the beatmap library, one set directory per archive
+     *
+     * Archives are read in memory and processed in parallel, nothing is extracted to a temporary directory.
+     */
+    ImportResult import_archives(const std::vector<std::string> &archives, const ImportOptions &options);
+} // namespace anisette::importer
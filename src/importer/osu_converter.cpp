@@ -0,0 +1,227 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "importer.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <random>
+
+#define OSU_MANIA_MODE 3
+#define OSU_PLAYFIELD_WIDTH 512
+#define OSU_TYPE_CIRCLE 0b00000001
+#define OSU_TYPE_HOLD 0b10000000
+#define MIN_CHANNEL_COUNT 4
+#define MAX_CHANNEL_COUNT 6
+#define MIN_RATING 10
+
+namespace anisette::importer
+{
+    enum Section {
+        NOT_DEFINED,
+        GENERAL,
+        METADATA,
+        DIFFICULTY,
+        EVENTS,
+        HIT_OBJECTS
+    };
+
+    // a hit object of the source map, column is the original osu! column
+    struct HitObject {
+        int start, end, column;
+    };
+
+    /**
+     * @brief Notes of one output channel, drops notes that overlap the previous one like the Python importer did
+     */
+    struct ChannelBuilder {
+        std::vector<data::Note> notes;
+        int next = 0;
+        int single_note_count = 0;
+        int hold_note_count = 0;
+
+        void append(const HitObject &object) {
+            if (object.end != 0 && object.end <= object.start) return;
+            if (object.start <= next) return;
+            notes.push_back({object.start, object.end});
+            if (object.end == 0) {
+                next = object.start;
+                single_note_count++;
+            } else {
+                next = object.end;
+                hold_note_count++;
+            }
+        }
+    };
+
+    static std::string_view trim(std::string_view str) {
+        while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) str.remove_prefix(1);
+        while (!str.empty() && (str.back() == ' ' || str.back() == '\t' || str.back() == '\r')) str.remove_suffix(1);
+        return str;
+    }
+
+    // value of a "Key: value" line if the line has that key
+    static bool read_field(const std::string_view line, const std::string_view key, std::string_view &value) {
+        if (line.size() <= key.size() || line.substr(0, key.size()) != key || line[key.size()] != ':') return false;
+        value = trim(line.substr(key.size() + 1));
+        return true;
+    }
+
+    static bool parse_int(const std::string_view str, int &value) {
+        const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+        return ec == std::errc() && end == str.data() + str.size();
+    }
+
+    static double parse_double(const std::string_view str) {
+        return std::strtod(std::string(str).c_str(), nullptr);
+    }
+
+    // osu! ratings are 0-10, ours start at 10 and the top of the osu! range maps to 50
+    static uint8_t convert_rating(const double value) {
+        const int rating = static_cast<int>(value * 10) - 50;
+        return static_cast<uint8_t>(std::clamp(rating, MIN_RATING, 100));
+    }
+
+    // split a line on commas into at most count fields
+    static size_t split(std::string_view line, std::string_view *fields, const size_t count) {
+        size_t n = 0;
+        while (n < count) {
+            const auto comma = line.find(',');
+            fields[n++] = line.substr(0, comma);
+            if (comma == std::string_view::npos) break;
+            line.remove_prefix(comma + 1);
+        }
+        return n;
+    }
+
+    bool convert_osu(std::string_view text, const unsigned fallback_id, ConvertedBeatmap &result, std::string &error) {
+        auto &beatmap = result.beatmap;
+        beatmap = {};
+        beatmap.difficulty = MIN_RATING;
+        beatmap.hp_drain = MIN_RATING;
+        int channels = 0;
+        int beatmap_id = 0;
+        std::vector<HitObject> objects;
+        Section section = NOT_DEFINED;
+        if (text.starts_with("\xEF\xBB\xBF")) text.remove_prefix(3);
+
+        while (!text.empty()) {
+            const auto newline = text.find('\n');
+            const auto line = trim(text.substr(0, newline));
+            text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+            if (line.empty() || line.starts_with("//")) continue;
+            if (line.front() == '[') {
+                if (line.starts_with("[General]")) section = GENERAL;
+                else if (line.starts_with("[Metadata]")) section = METADATA;
+                else if (line.starts_with("[Difficulty]")) section = DIFFICULTY;
+                else if (line.starts_with("[Events]")) section = EVENTS;
+                else if (line.starts_with("[HitObjects]")) section = HIT_OBJECTS;
+                else section = NOT_DEFINED;
+                continue;
+            }
+            std::string_view value;
+            switch (section) {
+                case GENERAL: {
+                    int number;
+                    if (read_field(line, "AudioFilename", value)) beatmap.music_path = value;
+                    else if (read_field(line, "PreviewTime", value) && parse_int(value, number)) {
+                        // -1 means no preview point
+                        beatmap.preview_point = number > 0 ? static_cast<unsigned>(number) : 0;
+                    } else if (read_field(line, "Mode", value) && parse_int(value, number) && number != OSU_MANIA_MODE) {
+                        error = "not an osu!mania map";
+                        return false;
+                    }
+                    break;
+                }
+                case METADATA:
+                    if (read_field(line, "Title", value)) beatmap.title = value;
+                    else if (read_field(line, "Artist", value)) beatmap.artist = value;
+                    else if (read_field(line, "BeatmapID", value)) parse_int(value, beatmap_id);
+                    break;
+                case DIFFICULTY:
+                    if (read_field(line, "OverallDifficulty", value)) beatmap.difficulty = convert_rating(parse_double(value));
+                    else if (read_field(line, "HPDrainRate", value)) beatmap.hp_drain = convert_rating(parse_double(value));
+                    else if (read_field(line, "CircleSize", value)) {
+                        channels = static_cast<int>(parse_double(value));
+                        if (channels < MIN_CHANNEL_COUNT || channels > MAX_CHANNEL_COUNT) {
+                            error = "only 4K, 5K and 6K beatmaps are supported";
+                            return false;
+                        }
+                    }
+                    break;
+                case EVENTS:
+                    // background image: 0,0,"filename",x,y
+                    if (line.starts_with("0,0")) {
+                        std::string_view fields[3];
+                        if (split(line, fields, 3) < 3) break;
+                        auto name = trim(fields[2]);
+                        if (name.size() >= 2 && name.front() == '"' && name.back() == '"') name = name.substr(1, name.size() - 2);
+                        beatmap.thumbnail_path = name;
+                    }
+                    break;
+                case HIT_OBJECTS: {
+                    if (channels < MIN_CHANNEL_COUNT) {
+                        error = "missing column count";
+                        return false;
+                    }
+                    // x,y,time,type,hitSound,endTime:hitSample
+                    std::string_view fields[6];
+                    if (split(line, fields, 6) < 6) break;
+                    int x, time, type, end = 0;
+                    if (!parse_int(fields[0], x) || !parse_int(fields[2], time) || !parse_int(fields[3], type)) break;
+                    if (type & OSU_TYPE_HOLD) {
+                        if (!parse_int(fields[5].substr(0, fields[5].find(':')), end)) break;
+                    } else if (!(type & OSU_TYPE_CIRCLE)) {
+                        break;
+                    }
+                    objects.push_back({time, end, x * channels / OSU_PLAYFIELD_WIDTH});
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        if (channels < MIN_CHANNEL_COUNT) {
+            error = "missing column count";
+            return false;
+        }
+        beatmap.id = beatmap_id > 0 ? static_cast<unsigned>(beatmap_id) : fallback_id;
+
+        // map the columns onto the 6 channels
+        ChannelBuilder output[6];
+        std::mt19937 random(beatmap.id);
+        const auto pick = [&random](const int a, const int b) { return random() & 1 ? b : a; };
+        for (const auto &object : objects) {
+            int channel = -1;
+            if (channels == 4) {
+                static constexpr int mapping[4] = {0, 2, 3, 5};
+                if (object.column == 0) channel = pick(0, 1);
+                else if (object.column == 3) channel = pick(4, 5);
+                else if (object.column >= 0 && object.column < 4) channel = mapping[object.column];
+            } else if (channels == 5) {
+                static constexpr int mapping[5] = {0, 1, 2, 4, 5};
+                if (object.column == 2) channel = pick(2, 3);
+                else if (object.column >= 0 && object.column < 5) channel = mapping[object.column];
+            } else if (object.column >= 0 && object.column < 6) {
+                channel = object.column;
+            }
+            if (channel >= 0) output[channel].append(object);
+        }
+
+        auto &chart = result.chart;
+        chart.clear();
+        for (int i = 0; i < 6; i++) {
+            chart.channel_begin[i] = static_cast<uint32_t>(chart.start.size());
+            for (const auto &note : output[i].notes) {
+                chart.start.push_back(note.start);
+                chart.end.push_back(note.end);
+            }
+            beatmap.single_note_count += output[i].single_note_count;
+            beatmap.hold_note_count += output[i].hold_note_count;
+        }
+        chart.channel_begin[6] = static_cast<uint32_t>(chart.start.size());
+        chart.build_timeline();
+        beatmap.star_rating = data::rate_chart(chart);
+        return true;
+    }
+} // namespace anisette::importer
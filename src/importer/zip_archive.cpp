@@ -0,0 +1,141 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "importer.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+
+#define ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define ZIP_END_SIGNATURE 0x06054b50
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_SIZE 22
+#define ZIP_MAX_COMMENT_SIZE 0xFFFF
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+#define ZIP_FLAG_ENCRYPTED 0x1
+
+namespace anisette::importer
+{
+    // zip fields are little-endian and unaligned
+    static uint16_t read_u16(const char *p) {
+        const auto b = reinterpret_cast<const unsigned char *>(p);
+        return static_cast<uint16_t>(b[0] | b[1] << 8);
+    }
+
+    static uint32_t read_u32(const char *p) {
+        const auto b = reinterpret_cast<const unsigned char *>(p);
+        return static_cast<uint32_t>(b[0]) | static_cast<uint32_t>(b[1]) << 8
+             | static_cast<uint32_t>(b[2]) << 16 | static_cast<uint32_t>(b[3]) << 24;
+    }
+
+    static bool iequals(const std::string_view a, const std::string_view b) {
+        return std::ranges::equal(a, b, [](const char x, const char y) {
+            return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+        });
+    }
+
+    bool ZipArchive::fail(const std::string &message) const {
+        error = message;
+        return false;
+    }
+
+    bool ZipArchive::open(const std::string &path) {
+        entries.clear();
+        if (!file.open(path)) return fail("cannot open file");
+        const char *data = file.data();
+        const size_t size = file.size();
+        if (size < ZIP_END_SIZE) return fail("not a zip archive");
+        // the end record sits behind an optional comment, search backwards for its signature
+        size_t end = size - ZIP_END_SIZE;
+        const size_t lowest = size > ZIP_END_SIZE + ZIP_MAX_COMMENT_SIZE ? size - ZIP_END_SIZE - ZIP_MAX_COMMENT_SIZE : 0;
+        while (read_u32(data + end) != ZIP_END_SIGNATURE) {
+            if (end == lowest) return fail("not a zip archive");
+            end--;
+        }
+        const auto disk = read_u16(data + end + 4);
+        const auto count = read_u16(data + end + 10);
+        const auto directory_size = read_u32(data + end + 12);
+        const auto directory_offset = read_u32(data + end + 16);
+        if (disk != 0) return fail("split archives are not supported");
+        if (directory_offset == UINT32_MAX || count == UINT16_MAX) return fail("zip64 archives are not supported");
+        if (static_cast<size_t>(directory_offset) + directory_size > end) return fail("corrupted central directory");
+
+        entries.reserve(count);
+        const char *cursor = data + directory_offset;
+        const char *directory_end = cursor + directory_size;
+        for (unsigned i = 0; i < count; i++) {
+            if (directory_end - cursor < ZIP_CENTRAL_HEADER_SIZE || read_u32(cursor) != ZIP_CENTRAL_HEADER_SIGNATURE) {
+                return fail("corrupted central directory");
+            }
+            const auto name_length = read_u16(cursor + 28);
+            const auto extra_length = read_u16(cursor + 30);
+            const auto comment_length = read_u16(cursor + 32);
+            const size_t record_size = ZIP_CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+            if (static_cast<size_t>(directory_end - cursor) < record_size) return fail("corrupted central directory");
+            ZipEntry entry;
+            entry.method = read_u16(cursor + 10);
+            entry.crc = read_u32(cursor + 16);
+            entry.compressed_size = read_u32(cursor + 20);
+            entry.size = read_u32(cursor + 24);
+            entry.header_offset = read_u32(cursor + 42);
+            entry.name.assign(cursor + ZIP_CENTRAL_HEADER_SIZE, name_length);
+            std::ranges::replace(entry.name, '\\', '/');
+            const bool encrypted = read_u16(cursor + 8) & ZIP_FLAG_ENCRYPTED;
+            cursor += record_size;
+            // directories and files we cannot read are left out, the caller only looks entries up by name
+            if (entry.name.empty() || entry.name.back() == '/' || encrypted) continue;
+            if (entry.size == UINT32_MAX || entry.compressed_size == UINT32_MAX) return fail("zip64 archives are not supported");
+            entries.push_back(std::move(entry));
+        }
+        return true;
+    }
+
+    const ZipEntry *ZipArchive::find(const std::string_view name) const {
+        const ZipEntry *folded = nullptr;
+        for (const auto &entry : entries) {
+            if (entry.name == name) return &entry;
+            if (!folded && iequals(entry.name, name)) folded = &entry;
+        }
+        return folded;
+    }
+
+    bool ZipArchive::extract(const ZipEntry &entry, std::string &out) const {
+        const char *data = file.data();
+        const size_t size = file.size();
+        if (static_cast<size_t>(entry.header_offset) + ZIP_LOCAL_HEADER_SIZE > size
+            || read_u32(data + entry.header_offset) != ZIP_LOCAL_HEADER_SIGNATURE) {
+            return fail(entry.name + ": corrupted local header");
+        }
+        // the local name and extra field may differ from the central directory, only their lengths matter
+        const size_t offset = static_cast<size_t>(entry.header_offset) + ZIP_LOCAL_HEADER_SIZE
+                            + read_u16(data + entry.header_offset + 26) + read_u16(data + entry.header_offset + 28);
+        if (offset > size || size - offset < entry.compressed_size) return fail(entry.name + ": truncated data");
+        const auto *input = reinterpret_cast<const Bytef *>(data + offset);
+
+        out.resize(entry.size);
+        if (entry.method == ZIP_METHOD_STORED) {
+            if (entry.compressed_size != entry.size) return fail(entry.name + ": corrupted stored entry");
+            std::copy_n(data + offset, entry.size, out.data());
+        } else if (entry.method == ZIP_METHOD_DEFLATED) {
+            z_stream stream {};
+            // negative window bits: raw deflate data without a zlib header
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) return fail(entry.name + ": inflate init failed");
+            stream.next_in = const_cast<Bytef *>(input);
+            stream.avail_in = entry.compressed_size;
+            stream.next_out = reinterpret_cast<Bytef *>(out.data());
+            stream.avail_out = entry.size;
+            const int result = inflate(&stream, Z_FINISH);
+            const auto produced = stream.total_out;
+            inflateEnd(&stream);
+            if (result != Z_STREAM_END || produced != entry.size) return fail(entry.name + ": corrupted deflate data");
+        } else {
+            return fail(entry.name + ": unsupported compression method " + std::to_string(entry.method));
+        }
+        const auto crc = crc32(0L, reinterpret_cast<const Bytef *>(out.data()), entry.size);
+        if (crc != entry.crc) return fail(entry.name + ": CRC mismatch");
+        return true;
+    }
+} // namespace anisette::importer
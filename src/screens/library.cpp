@@ -5,6 +5,7 @@
 #include "discord.h"
 #include "logging.h"
 #include <algorithm>
+#include <memory>
 
 const static auto logger = anisette::logging::get("library");
 
@@ -16,33 +17,46 @@ constexpr static SDL_Color diff_color[COLOR_RANGE] = {
     {240, 73, 35, 255}, // red (#F04923)
 };
 constexpr static int diff_color_bound[COLOR_RANGE] = {0, 15, 25, 35};
+constexpr static const char *sort_strategy_name[] = {"ID", "title", "artist", "difficulty", "star rating"};
+// up and down arrows change the rate modifier by this much
+constexpr static int RATE_STEP_PERCENT = 5;
 
 namespace anisette::screens
 {
+    // hundredths of a star as "x.yz"
+    static std::string format_star_rating(const uint16_t rating) {
+        const auto fraction = std::to_string(rating % 100);
+        return std::to_string(rating / 100) + (fraction.size() < 2 ? ".0" : ".") + fraction;
+    }
+
     components::Container* create_beatmap_info_view(const data::Beatmap* beatmap) {
         using namespace anisette::components;
         if (!beatmap) return nullptr;
         const uint64_t note_count = beatmap->single_note_count + beatmap->hold_note_count;
         // header
-        const auto thumbnail_img = new Image(beatmap->thumbnail_path);
+        const auto thumbnail_img = new Image(beatmap->thumbnail_path, beatmap->thumbnail_id);
         const auto title_text = new Text(beatmap->title, 24, BTN_TEXT_COLOR);
         title_text->font = core::video::primary_font;
         // labels
         const auto artist_label = new Text("Artist:", 20, BTN_TEXT_COLOR);
         const auto difficulty_label = new Text("Difficulty:", 20, BTN_TEXT_COLOR);
+        const auto star_rating_label = new Text("Stars:", 20, BTN_TEXT_COLOR);
         const auto note_count_label = new Text("Notes:", 20, BTN_TEXT_COLOR);
         // texts
         const auto artist_text = new Text(beatmap->artist, 16, BTN_TEXT_COLOR);
         const auto difficulty_text = new Text(std::to_string(beatmap->difficulty), 16, BTN_TEXT_COLOR);
+        const auto star_rating_text = new Text(format_star_rating(beatmap->star_rating), 16, BTN_TEXT_COLOR);
         const auto note_count_text = new Text(std::to_string(note_count), 16, BTN_TEXT_COLOR);
         // label
         const auto label_vbox = new VerticalBox(0, 2);
         label_vbox->add_item(new ItemWrapper(artist_label))
                   ->add_item(new ItemWrapper(difficulty_label))
+                  ->add_item(new ItemWrapper(star_rating_label))
                   ->add_item(new ItemWrapper(note_count_label));
         const auto text_vbox = new VerticalBox(0, 2);
         text_vbox->add_item(new ItemWrapper(artist_text))
                  ->add_item(new ItemWrapper(difficulty_text))
+                 ->add_item(new ItemWrapper(star_rating_text))
                  ->add_item(new ItemWrapper(note_count_text));
         // main vbox
         const auto vbox = new VerticalBox(10, 2);
@@ -59,6 +73,9 @@ namespace anisette::screens
     }
 
     int LibraryScreen::selected_song_index = 0;
+    data::SortStrategy LibraryScreen::sort_strategy = data::BY_DIFFICULTY;
+    bool LibraryScreen::sort_ascending = true;
+    int LibraryScreen::rate_percent = 100;
 
     LibraryScreen::LibraryScreen(SDL_Renderer *renderer) {
         using namespace components;
@@ -66,7 +83,8 @@ namespace anisette::screens
         for (int i = 0; i < 5; i++) view_wrapper[i] = new ContainerWrapper();
 
         const auto logo_icon = new Image("assets/icons/app.png");
-        const auto title_text = new Text("Select a song", 24, BTN_TEXT_COLOR);
+        title_text = new Text("", 24, BTN_TEXT_COLOR);
+        update_title_text();
 
         back_btn      = new IconButton("assets/icons/back.png", BTN_TRANSPARENT_COLOR, BTN_HOVER_COLOR);
         arr_left_btn  = new IconButton("assets/icons/arrow_left.png", BTN_BG_COLOR, BTN_HOVER_COLOR);
@@ -102,28 +120,34 @@ namespace anisette::screens
         main_layout.add_item(bottom_bar, 10);
 
         // load view
-        beatmap_view.clear();
+        library = core::beatmap_loader->snapshot();
+        rebuild_view();
+        // action hooks
+        action_start_time = SDL_GetPerformanceCounter();
+    }
 
+    void LibraryScreen::rebuild_view() {
+        beatmap_view.clear();
+        const int count = view_size();
+        if (selected_song_index >= count) selected_song_index = count - 1;
         if (selected_song_index < 0) selected_song_index = 0;
-        if (selected_song_index >= core::beatmap_loader->beatmaps.size()) selected_song_index = core::beatmap_loader->beatmaps.size() - 1;
 
         for (int i = -2; i <= 2; i++) {
-            if (selected_song_index + i < 0) {
-                beatmap_view.emplace_back();
-            } else if (selected_song_index + i >= core::beatmap_loader->beatmaps.size()) {
+            if (selected_song_index + i < 0 || selected_song_index + i >= count) {
                 beatmap_view.emplace_back();
-                continue;
             } else {
-                beatmap_view.emplace_back(i + 2, &core::beatmap_loader->beatmaps[selected_song_index + i]);
+                beatmap_view.emplace_back(i + 2, beatmap_at(selected_song_index + i));
             }
             view_wrapper[i + 2]->set_back_container(beatmap_view.at(i + 2).view);
         }
-        // action hooks
-        action_start_time = SDL_GetPerformanceCounter();
     }
 
     void LibraryScreen::on_focus(const uint64_t &now) {
         utils::discord::set_browsing_library();
+        // previews are heard at the rate the stage will be played at
+        core::audio::set_music_rate(rate_percent);
+        // type anywhere to search
+        SDL_StartTextInput();
         core::toggle_background_parallax(true);
         // fade in
         if (action_hook.empty()) action_start_time = now;
@@ -145,6 +169,23 @@ namespace anisette::screens
     }
 
     void LibraryScreen::update(const uint64_t &now) {
+        // pick up a newer library snapshot, but never while a hook is running on the current view
+        if (action_hook.empty() && core::beatmap_loader->generation() != library->generation) {
+            auto selected = library->handle_at(slot_at(selected_song_index));
+            library = core::beatmap_loader->snapshot();
+            if (!search_query.empty()) search_result = library->search(search_query, sort_strategy, sort_ascending);
+            // an empty selection has no beatmap to follow, resolving its id 0 could jump to a real beatmap
+            if (selected.valid() && library->resolve(selected)) selected_song_index = position_of(selected.slot);
+            rebuild_view();
+            update_title_text();
+            logger->debug("Beatmap library reloaded, {} beatmaps", library->size());
+            action_start_time = now;
+            action_hook.emplace([this](const uint64_t &action_now) {
+                reload_selected_beatmap(action_now);
+                return true;
+            });
+        }
+
         // draw main layout
         if (screen_dim_alpha < 255) main_layout.draw(renderer, core::video::render_rect);
 
@@ -166,13 +207,23 @@ namespace anisette::screens
 
     void LibraryScreen::on_event(const uint64_t &now, const SDL_Event &event) {
         if (event.type == core::audio::MUSIC_FINISHED_EVENT_ID) {
-            const auto current_beatmap = beatmap_view[2].beatmap;
+            const auto &current_beatmap = beatmap_view[2].beatmap;
             if (!current_beatmap) {
                 logger->warn("No beatmap selected");
                 return;
             }
-            core::audio::play_music(current_beatmap->music_path, current_beatmap->title + " - " + current_beatmap->artist);
-            core::audio::seek_music(current_beatmap->preview_point);
+            core::audio::play_preview(current_beatmap->music_path, current_beatmap->title + " - " + current_beatmap->artist,
+                                      current_beatmap->music_id, current_beatmap->preview_point);
+        } else if (event.type == SDL_TEXTINPUT) {
+            search_query += event.text.text;
+            apply_search(now);
+        } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_BACKSPACE) {
+            if (search_query.empty()) return;
+            // drop the last UTF-8 character
+            size_t length = search_query.size() - 1;
+            while (length > 0 && (static_cast<unsigned char>(search_query[length]) & 0xC0) == 0x80) length--;
+            search_query.resize(length);
+            apply_search(now);
         } else if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_KEYDOWN) {
             core::audio::play_click_sound();
         } else if (event.type == SDL_MOUSEBUTTONUP) {
@@ -201,7 +252,10 @@ namespace anisette::screens
             }
         } else if (event.type == SDL_KEYUP) {
             const auto key = event.key.keysym.sym;
-            if (key == SDLK_ESCAPE) {
+            if (key == SDLK_ESCAPE && !search_query.empty()) {
+                search_query.clear();
+                apply_search(now);
+            } else if (key == SDLK_ESCAPE) {
                 if (action_hook.empty()) action_start_time = now;
                 action_hook.emplace([this](const uint64_t &action_now) {
                     const auto delta = action_now > action_start_time ? action_now - action_start_time : 0;
@@ -221,16 +275,105 @@ namespace anisette::screens
                 prev_beatmap(now);
             } else if (key == SDLK_RIGHT) {
                 next_beatmap(now);
+            } else if (key == SDLK_UP) {
+                change_rate(rate_percent + RATE_STEP_PERCENT);
+            } else if (key == SDLK_DOWN) {
+                change_rate(rate_percent - RATE_STEP_PERCENT);
+            } else if (key == SDLK_TAB && (event.key.keysym.mod & KMOD_SHIFT)) {
+                change_sort(sort_strategy, !sort_ascending);
+            } else if (key == SDLK_TAB) {
+                change_sort(static_cast<data::SortStrategy>((sort_strategy + 1) % data::NONE), sort_ascending);
             }
         }
     }
 
+    int LibraryScreen::view_size() const {
+        return static_cast<int>(search_query.empty() ? library->size() : search_result.size());
+    }
+
+    uint32_t LibraryScreen::slot_at(const int position) const {
+        if (position < 0 || position >= view_size()) return utils::FlatIndex::NOT_FOUND;
+        if (!search_query.empty()) return search_result[position];
+        return library->slot_at(sort_strategy, sort_ascending, position);
+    }
+
+    int LibraryScreen::position_of(const uint32_t slot) const {
+        if (search_query.empty()) return static_cast<int>(library->position_of(sort_strategy, sort_ascending, slot));
+        const auto it = std::ranges::find(search_result, slot);
+        return it == search_result.end() ? 0 : static_cast<int>(it - search_result.begin());
+    }
+
+    std::optional<data::Beatmap> LibraryScreen::beatmap_at(const int position) const {
+        const auto slot = slot_at(position);
+        if (slot == utils::FlatIndex::NOT_FOUND) return std::nullopt;
+        return library->get(slot);
+    }
+
+    void LibraryScreen::change_sort(const data::SortStrategy strategy, const bool ascending) {
+        // the selection stays on the same beatmap, only its position changes
+        const auto slot = slot_at(selected_song_index);
+        sort_strategy = strategy;
+        sort_ascending = ascending;
+        // equal search matches follow the sort order
+        if (!search_query.empty()) search_result = library->search(search_query, sort_strategy, sort_ascending);
+        if (slot != utils::FlatIndex::NOT_FOUND) selected_song_index = position_of(slot);
+        rebuild_view();
+        update_title_text();
+        logger->debug("Sort library by {} ({})", sort_strategy_name[sort_strategy], sort_ascending ? "ascending" : "descending");
+    }
+
+    void LibraryScreen::change_rate(const int percent) {
+        const int rate = std::clamp(percent, core::audio::MIN_MUSIC_RATE, core::audio::MAX_MUSIC_RATE);
+        if (rate == rate_percent) return;
+        rate_percent = rate;
+        core::audio::set_music_rate(rate_percent);
+        update_title_text();
+        logger->debug("Rate set to {}%", rate_percent);
+    }
+
+    void LibraryScreen::apply_search(const uint64_t &now) {
+        const auto selected = slot_at(selected_song_index);
+        if (search_query.empty()) {
+            // back to the full list, stay on the beatmap picked from the results
+            search_result.clear();
+            if (selected != utils::FlatIndex::NOT_FOUND) selected_song_index = position_of(selected);
+        } else {
+            // best match first
+            search_result = library->search(search_query, sort_strategy, sort_ascending);
+            selected_song_index = 0;
+        }
+        rebuild_view();
+        update_title_text();
+        if (slot_at(selected_song_index) == selected) return;
+        if (action_hook.empty()) action_start_time = now;
+        action_hook.emplace([this](const uint64_t &action_now) {
+            reload_selected_beatmap(action_now);
+            return true;
+        });
+    }
+
+    void LibraryScreen::update_title_text() const {
+        // e.g. " - 1.25x", nothing at the normal rate
+        std::string rate_text;
+        if (rate_percent != 100) {
+            rate_text = " - " + std::to_string(rate_percent / 100) + (rate_percent % 100 < 10 ? ".0" : ".")
+                + std::to_string(rate_percent % 100) + "x";
+        }
+        if (!search_query.empty()) {
+            title_text->change_text("Search: " + search_query + " - " + std::to_string(search_result.size()) + " found"
+                + rate_text);
+            return;
+        }
+        title_text->change_text(std::string("Select a song - by ") + sort_strategy_name[sort_strategy]
+            + (sort_ascending ? " (asc)" : " (desc)") + rate_text);
+    }
+
     void LibraryScreen::prev_beatmap(const uint64_t &now) {
         if (selected_song_index == 0) return;
         selected_song_index--;
         beatmap_view.pop_back();
         if (selected_song_index - 2 < 0) beatmap_view.emplace_front();
-        else beatmap_view.emplace_front(selected_song_index - 2, &core::beatmap_loader->beatmaps[selected_song_index - 2]);
+        else beatmap_view.emplace_front(selected_song_index - 2, beatmap_at(selected_song_index - 2));
         for (int i = 0; i < 5; i++) view_wrapper[i]->set_back_container(beatmap_view.at(i).view);
         if (action_hook.empty()) action_start_time = now;
         action_hook.emplace([this](const uint64_t &action_now) {
@@ -240,11 +383,11 @@ namespace anisette::screens
     }
 
     void LibraryScreen::next_beatmap(const uint64_t &now) {
-        if (selected_song_index == core::beatmap_loader->beatmaps.size() - 1) return;
+        if (selected_song_index >= view_size() - 1) return;
         selected_song_index++;
         beatmap_view.pop_front();
-        if (selected_song_index + 2 >= core::beatmap_loader->beatmaps.size()) beatmap_view.emplace_back();
-        else beatmap_view.emplace_back(selected_song_index + 2, &core::beatmap_loader->beatmaps[selected_song_index + 2]);
+        if (selected_song_index + 2 >= view_size()) beatmap_view.emplace_back();
+        else beatmap_view.emplace_back(selected_song_index + 2, beatmap_at(selected_song_index + 2));
         for (int i = 0; i < 5; i++) view_wrapper[i]->set_back_container(beatmap_view.at(i).view);
         if (action_hook.empty()) action_start_time = now;
         action_hook.emplace([this](const uint64_t &action_now) {
@@ -254,7 +397,7 @@ namespace anisette::screens
     }
 
     void LibraryScreen::reload_selected_beatmap(const uint64_t &now) const {
-        const auto current_beatmap = beatmap_view[2].beatmap;
+        const auto &current_beatmap = beatmap_view[2].beatmap;
         if (!current_beatmap) {
             logger->warn("No beatmap selected");
             return;
@@ -262,34 +405,55 @@ namespace anisette::screens
         logger->debug("Selected beatmap ID: {}", current_beatmap->id);
         if (current_beatmap->music_path.empty()) {
             logger->warn("Beatmap ID {} has no music path", current_beatmap->id);
-        } else if (core::audio::music_path != current_beatmap->music_path) {
-            core::audio::play_music(current_beatmap->music_path, current_beatmap->title + " - " + current_beatmap->artist);
-            core::audio::seek_music(current_beatmap->preview_point);
+        } else if (current_beatmap->music_id != 0 ? core::audio::music_id != current_beatmap->music_id
+                                                  : core::audio::music_path != current_beatmap->music_path) {
+            // sibling difficulties share their music, the preview keeps playing while moving between them
+            core::audio::play_preview(current_beatmap->music_path, current_beatmap->title + " - " + current_beatmap->artist,
+                                      current_beatmap->music_id, current_beatmap->preview_point);
         }
+        prefetch_neighbour_previews();
         if (current_beatmap->thumbnail_path.empty()) {
             logger->warn("Beatmap ID {} has no thumbnail path", current_beatmap->id);
         } else {
-            core::load_background(current_beatmap->thumbnail_path, now);
+            core::load_background(current_beatmap->thumbnail_path, now, current_beatmap->thumbnail_id);
+        }
+    }
+
+    void LibraryScreen::prefetch_neighbour_previews() const {
+        // the next step in either direction first, the selected song last so scrolling back to it is instant too
+        std::vector<core::audio::PreviewRequest> requests;
+        for (const int i : {1, 3, 0, 4, 2}) {
+            const auto &beatmap = beatmap_view[i].beatmap;
+            if (!beatmap || beatmap->music_path.empty()) continue;
+            requests.push_back({beatmap->music_path, beatmap->music_id, static_cast<int>(beatmap->preview_point)});
         }
+        core::audio::prefetch_previews(std::move(requests));
     }
 
     void LibraryScreen::launch_stage(const uint64_t &now) {
-        const auto current_beatmap = beatmap_view[2].beatmap;
-        if (!current_beatmap) {
+        if (!beatmap_view[2].beatmap) {
             logger->warn("No beatmap selected");
             return;
         }
+        // the library only keeps the headers, notes live as long as the stage. Without them the stage would never
+        // finish, the beatmap is not launched at all
+        auto chart = std::make_shared<data::NoteChart>();
+        if (!beatmap_view[2].beatmap->load_notes(*chart) || chart->timeline.empty()) {
+            logger->error("Failed to load notes of beatmap ID {}, not launching it", beatmap_view[2].beatmap->id);
+            return;
+        }
 
         if (action_hook.empty()) action_start_time = now;
         // hook fade out then open stage
-        action_hook.emplace([this, current_beatmap](const uint64_t &action_now) {
+        action_hook.emplace([this, current_beatmap = *beatmap_view[2].beatmap, chart](const uint64_t &action_now) {
             const auto delta = action_now > action_start_time ? action_now - action_start_time : 0;
             const auto alpha = 255 * delta / fade_duration;
             if (alpha > 255) {
                 screen_dim_alpha = 255;
                 logger->debug("Fade out finished");
-                logger->info("Launch stage with beatmap ID: {}", current_beatmap->id);
-                core::open(new StageScreen(renderer, current_beatmap));
+                logger->info("Launch stage with beatmap ID: {}", current_beatmap.id);
+                SDL_StopTextInput();
+                core::open(new StageScreen(renderer, current_beatmap, std::move(*chart), rate_percent));
                 return true;
             }
             screen_dim_alpha = alpha;
@@ -297,12 +461,21 @@ namespace anisette::screens
         });
     }
 
-    LibraryScreen::~LibraryScreen() {}
+    LibraryScreen::~LibraryScreen() {
+        // started for the search in on_focus, leaving by ESC or the back button ends here
+        SDL_StopTextInput();
+        // the search is not kept, remember the selection as a position of the full list
+        if (!search_query.empty()) {
+            const auto slot = slot_at(selected_song_index);
+            search_query.clear();
+            selected_song_index = slot == utils::FlatIndex::NOT_FOUND ? 0 : position_of(slot);
+        }
+    }
 
-    LibraryScreen::BeatmapViewItem::BeatmapViewItem(const int index, data::Beatmap *beatmap) {
+    LibraryScreen::BeatmapViewItem::BeatmapViewItem(const int index, std::optional<data::Beatmap> &&beatmap) {
         this->index = index;
-        this->beatmap = beatmap;
-        view = create_beatmap_info_view(beatmap);
+        this->beatmap = std::move(beatmap);
+        view = create_beatmap_info_view(this->beatmap ? &*this->beatmap : nullptr);
     }
 
      LibraryScreen::BeatmapViewItem::~BeatmapViewItem() {
@@ -10,6 +10,7 @@
 #include "screens.h"
 
 #define VOLUME_CHANGE_STEP 4
+#define SCAN_PROGRESS_BASE 1000
 
 const auto logger = anisette::logging::get("menu");
 
@@ -66,10 +67,17 @@ namespace anisette::screens
         volume_overlay->add_item(new ItemWrapper(volume_text), 0);
         volume_overlay->add_item(new ItemWrapper(volume_bar), 85);
         volume_overlay->set_hidden(true);
+        // beatmap scan progress, shown while the library is still streaming in
+        scan_progress_text = new Text("Loading beatmaps", 16, BTN_TEXT_COLOR);
+        scan_progress_bar  = new ProgressBar(SCAN_PROGRESS_BASE, BTN_HOVER_COLOR, BTN_BG_COLOR);
+        scan_progress_overlay = new HorizontalBox(0, 2);
+        scan_progress_overlay->add_item(new ItemWrapper(scan_progress_text), 0);
+        scan_progress_overlay->add_item(new ItemWrapper(scan_progress_bar), 40);
         // add elements to the grid
         grid.add_child(vbox, GridChildProperties::CENTER, GridChildProperties::MIDDLE, 80, 50);
         grid.add_child(music_control, GridChildProperties::RIGHT, GridChildProperties::TOP, 70, 4);
         grid.add_child(volume_overlay, GridChildProperties::LEFT, GridChildProperties::BOTTOM, 70, 3);
+        grid.add_child(scan_progress_overlay, GridChildProperties::LEFT, GridChildProperties::TOP, 30, 3);
         // action hook
         action_start_time = SDL_GetPerformanceCounter();
         // add hook to play music from a random beatmap
@@ -80,15 +88,16 @@ namespace anisette::screens
     }
 
     void MenuScreen::play_random_music() const {
-        if (core::beatmap_loader->beatmaps.empty()) {
+        const auto library = core::beatmap_loader->snapshot();
+        if (library->empty()) {
             logger->error("No beatmaps found");
             return;
         }
         logger->debug("Play random music");
-        const auto beatmap = core::beatmap_loader->beatmaps[utils::randint(0, core::beatmap_loader->beatmaps.size() - 1)];
+        const auto beatmap = library->get(utils::randint(0, library->size() - 1));
         const auto music_path = beatmap.music_path;
         const auto display_name = beatmap.title + " - " + beatmap.artist;
-        if (core::audio::play_music(music_path, display_name)) {
+        if (core::audio::play_music(music_path, display_name, beatmap.music_id)) {
             now_playing_text->change_text(display_name);
             music_play_btn_wrapper->set_hidden(true);
             music_pause_btn_wrapper->set_hidden(false);
@@ -102,7 +111,7 @@ namespace anisette::screens
     void MenuScreen::on_click(const uint64_t &now, const int x, const int y) {
         if (utils::check_point_in_rect(x, y, play_btn->last_area)) {
             logger->debug("Clicked play button");
-            if (core::beatmap_loader->beatmaps.empty()) logger->warn("No beatmaps found");
+            if (core::beatmap_loader->snapshot()->empty()) logger->warn("No beatmaps found");
             // hook fade out + switch to library screen
             else {
                 if (action_hook.empty()) action_start_time = now;
@@ -181,6 +190,24 @@ namespace anisette::screens
         }
         if (!load_async_finshed) return;
 
+        // update scan progress until the library is complete, then rating progress of the beatmaps parsed by the scan
+        if (!scan_progress_overlay_hidden) {
+            if (core::beatmap_loader->is_scan_finished()) {
+                if (const auto [done, total] = core::beatmap_loader->get_rating_progress(); done >= total) {
+                    scan_progress_overlay->set_hidden(true);
+                    scan_progress_overlay_hidden = true;
+                } else if (done != last_rating_done) {
+                    last_rating_done = done;
+                    scan_progress_bar->value = static_cast<int>(static_cast<uint64_t>(done) * SCAN_PROGRESS_BASE / total);
+                    scan_progress_text->change_text("Rating beatmaps " + std::to_string(done) + "/" + std::to_string(total));
+                }
+            } else if (const auto [done, total] = core::beatmap_loader->get_scan_progress(); done != last_scan_done) {
+                last_scan_done = done;
+                scan_progress_bar->value = total ? static_cast<int>(static_cast<uint64_t>(done) * SCAN_PROGRESS_BASE / total) : 0;
+                scan_progress_text->change_text("Loading beatmaps " + std::to_string(done) + "/" + std::to_string(total));
+            }
+        }
+
         // if volume changes, show overlay
         if (volume_overlay_hide_time != 0 && now > volume_overlay_hide_time) volume_overlay->set_hidden(true);
 
@@ -254,11 +281,11 @@ namespace anisette::screens
                     default_backgrounds.push_back(entry.path().string());
                 }
             }
-            // if no beatmaps loaded, disable play button
-            while (!core::beatmap_loader->is_scan_finished()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            // wait for the first beatmaps, if the scan found nothing disable play button
+            while (core::beatmap_loader->generation() == 0 && !core::beatmap_loader->is_scan_finished()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
             }
-            if (core::beatmap_loader->beatmaps.empty()) {
+            if (core::beatmap_loader->is_scan_finished() && core::beatmap_loader->snapshot()->empty()) {
                 play_btn->background = BTN_DISABLED_COLOR;
                 play_btn->hover_background = BTN_DISABLED_COLOR;
             }
@@ -273,6 +300,8 @@ namespace anisette::screens
 
     void MenuScreen::on_focus(const uint64_t &now) {
         utils::discord::set_in_main_menu();
+        // the rate modifier only applies to the library and the stage
+        core::audio::set_music_rate(100);
         // choose a random background
         if (default_backgrounds.empty()) {
             logger->error("No background found");
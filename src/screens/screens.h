@@ -5,6 +5,7 @@
 #include "core.h"
 #include "stage_channel.h"
 #include "container.h"
+#include <optional>
 #include <queue>
 
 namespace anisette::screens {
@@ -18,7 +19,12 @@ namespace anisette::screens {
 
     class StageScreen final : public core::abstract::Screen {
     public:
-        explicit StageScreen(SDL_Renderer *renderer, data::Beatmap *beatmap);
+        /**
+         * @param chart Notes of the beatmap, loaded by the caller so a beatmap without notes is never launched
+         * @param rate_percent Playback rate of the music, the chart and its judgement follow it
+         */
+        StageScreen(SDL_Renderer *renderer, const data::Beatmap &beatmap, data::NoteChart &&chart,
+                    int rate_percent = 100);
         ~StageScreen() override;
 
         void on_event(const uint64_t &now, const SDL_Event &event) override;
@@ -37,11 +43,20 @@ namespace anisette::screens {
 
 
         int current_music_pos_ms = -5000;
+        // the lead-in before the music runs on the tick counter, the rest on the audio clock
         int last_tick = 0;
+        double lead_in_ms = -5000;
+        bool music_loaded = false;
+        bool music_started = false;
         bool paused = true;
+        bool finished = false;
         bool show_result_overlay = false;
 
-        data::Beatmap *beatmap;
+        // a copy, the library snapshot it comes from may be replaced while playing
+        const data::Beatmap beatmap;
+        data::NoteChart chart;
+        // when the last note is released, holds included
+        int32_t last_release_ms = 0;
         utils::ScoreCalculator *score_calculator;
 
         int screen_dim_alpha = 0;
@@ -51,7 +66,12 @@ namespace anisette::screens {
 
     class LibraryScreen final : public core::abstract::Screen {
     public:
+        // position in the current sort order, or in the search result while searching
         static int selected_song_index;
+        static data::SortStrategy sort_strategy;
+        static bool sort_ascending;
+        // playback rate of previews and of the stage, in percent
+        static int rate_percent;
 
         explicit LibraryScreen(SDL_Renderer *renderer);
         ~LibraryScreen() override;
@@ -62,11 +82,11 @@ namespace anisette::screens {
 
         struct BeatmapViewItem {
             int index = -1;
-            data::Beatmap* beatmap = nullptr;
+            std::optional<data::Beatmap> beatmap;
             components::Container* view = nullptr;
 
             BeatmapViewItem() = default;
-            BeatmapViewItem(int index, data::Beatmap* beatmap);
+            BeatmapViewItem(int index, std::optional<data::Beatmap> &&beatmap);
             ~BeatmapViewItem();
         };
 
@@ -75,7 +95,18 @@ namespace anisette::screens {
         void next_beatmap(const uint64_t &now);
         void prev_beatmap(const uint64_t &now);
         void reload_selected_beatmap(const uint64_t &now) const;
-
+        void prefetch_neighbour_previews() const;
+        void rebuild_view();
+        int view_size() const;
+        uint32_t slot_at(int position) const;
+        int position_of(uint32_t slot) const;
+        std::optional<data::Beatmap> beatmap_at(int position) const;
+        void change_sort(data::SortStrategy strategy, bool ascending);
+        void change_rate(int percent);
+        void apply_search(const uint64_t &now);
+        void update_title_text() const;
+
+        components::Text          *title_text;
         components::IconButton    *back_btn;
         components::IconButton    *arr_left_btn;
         components::IconButton    *arr_right_btn;
@@ -85,6 +116,11 @@ namespace anisette::screens {
         components::HorizontalBox *bottom_bar;
         components::VerticalBox    main_layout {0, 2};
 
+        // the view holds copies of the beatmaps it shows, slots refer to this snapshot
+        data::LibraryRef library;
+        // while searching, the view walks the matched slots instead of the sort order
+        std::string search_query;
+        std::vector<uint32_t> search_result;
         std::deque<BeatmapViewItem> beatmap_view{5};
         components::ContainerWrapper* view_wrapper[5];
 
@@ -129,6 +165,13 @@ namespace anisette::screens {
         components::ProgressBar *volume_bar;
         components::HorizontalBox *volume_overlay;
         uint64_t volume_overlay_hide_time = 0;
+        // scan progress overlay
+        components::Text        *scan_progress_text;
+        components::ProgressBar *scan_progress_bar;
+        components::HorizontalBox *scan_progress_overlay;
+        uint32_t last_scan_done = UINT32_MAX;
+        uint32_t last_rating_done = UINT32_MAX;
+        bool scan_progress_overlay_hidden = false;
         // main grid
         components::Grid grid {2};
 
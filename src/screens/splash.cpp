@@ -53,9 +53,9 @@ namespace anisette::screens {
             return;
         }
         action_start_time = now;
-        // hook check if beatmap loader is ready
+        // hook check if the first beatmaps are ready, the rest keeps streaming in the background
         action_hook.emplace([this](const uint64_t &action_now) {
-            return core::beatmap_loader->is_scan_finished();
+            return core::beatmap_loader->generation() > 0 || core::beatmap_loader->is_scan_finished();
         });
         // hook check if menu screen is loaded
         action_hook.emplace([this](const uint64_t &action_now) {
@@ -4,6 +4,7 @@
 #include "screens.h"
 #include "discord.h"
 #include "logging.h"
+#include <algorithm>
 
 // Keymap: S D F J K L
 #define STAGE_TEXT_PRIMARY_SIZE 40
@@ -13,17 +14,23 @@ const static auto logger = anisette::logging::get("stage");
 
 namespace anisette::screens
 {
-    StageScreen::StageScreen(SDL_Renderer *renderer, data::Beatmap *beatmap) : beatmap(beatmap) {
+    StageScreen::StageScreen(SDL_Renderer *renderer, const data::Beatmap &beatmap, data::NoteChart &&chart,
+                             const int rate_percent)
+        : beatmap(beatmap), chart(std::move(chart)) {
         using namespace components;
         this->renderer = renderer;
-        logger->debug("Set base offset to {}ms", (100 - beatmap->difficulty) * 3 / 2);
-        score_calculator = new utils::ScoreCalculator((100 - beatmap->difficulty) * 3 / 2, beatmap->hp_drain);
-        channel[0] = new StageChannel(score_calculator, &beatmap->notes[0], "S");
-        channel[1] = new StageChannel(score_calculator, &beatmap->notes[1], "D");
-        channel[2] = new StageChannel(score_calculator, &beatmap->notes[2], "F");
-        channel[3] = new StageChannel(score_calculator, &beatmap->notes[3], "J");
-        channel[4] = new StageChannel(score_calculator, &beatmap->notes[4], "K");
-        channel[5] = new StageChannel(score_calculator, &beatmap->notes[5], "L");
+        for (uint32_t i = 0; i < this->chart.size(); i++) {
+            last_release_ms = std::max({last_release_ms, this->chart.start[i], this->chart.end[i]});
+        }
+        logger->debug("Set base offset to {}ms at {}% rate", (100 - beatmap.difficulty) * 3 / 2, rate_percent);
+        score_calculator = new utils::ScoreCalculator((100 - beatmap.difficulty) * 3 / 2, beatmap.hp_drain,
+                                                      rate_percent);
+        channel[0] = new StageChannel(score_calculator, &this->chart, 0, "S");
+        channel[1] = new StageChannel(score_calculator, &this->chart, 1, "D");
+        channel[2] = new StageChannel(score_calculator, &this->chart, 2, "F");
+        channel[3] = new StageChannel(score_calculator, &this->chart, 3, "J");
+        channel[4] = new StageChannel(score_calculator, &this->chart, 4, "K");
+        channel[5] = new StageChannel(score_calculator, &this->chart, 5, "L");
         // temporary disable 2 channels for easier
         channel[0]->set_hidden(true);
         channel[5]->set_hidden(true);
@@ -90,9 +97,11 @@ namespace anisette::screens
             action_hook.pop();
             action_start_time = now;
         }
-        // if 6 channels finished, stop
-        if (channel[0]->finished && channel[1]->finished && channel[2]->finished && channel[3]->finished && channel[4]->finished && channel[5]->finished) {
-            logger->debug("All channels finished");
+        // once the last note is released and its judge window is over, hidden channels included, stop
+        if (!finished && chart.size() > 0
+            && current_music_pos_ms > last_release_ms + score_calculator->base_offset_ms) {
+            logger->debug("All notes finished");
+            finished = true;
             if (action_hook.empty()) action_start_time = now;
             action_hook.emplace([this](const uint64_t &action_now) {
                 const auto delta = action_now > action_start_time ? action_now - action_start_time : 0;
@@ -109,18 +118,29 @@ namespace anisette::screens
         }
         // scan key
         const auto scan_res = SDL_GetKeyboardState(nullptr);
+        // the music failed to decode after it started: fall back to the tick counter from where the chart is
+        if (music_started && core::audio::music_failed()) {
+            logger->error("Music failed to load, continuing without it");
+            music_started = false;
+            lead_in_ms = current_music_pos_ms;
+            last_tick = static_cast<int>(SDL_GetTicks());
+        }
         // bind values
-        if (!paused) {
+        if (music_started) {
+            current_music_pos_ms = core::audio::music_position_ms();
+        } else if (!paused) {
+            // the lead-in runs at the rate of the music, notes scroll at the same speed before and after it starts
             const auto this_tick = SDL_GetTicks();
-            current_music_pos_ms += this_tick - last_tick;
-            last_tick = this_tick;
+            lead_in_ms += static_cast<double>(this_tick - last_tick) * score_calculator->rate_percent / 100;
+            last_tick = static_cast<int>(this_tick);
+            current_music_pos_ms = static_cast<int>(lead_in_ms);
         }
-        channel[0]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_S]);
-        channel[1]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_D]);
-        channel[2]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_F]);
-        channel[3]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_J]);
-        channel[4]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_K]);
-        channel[5]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_L]);
+        channel[0]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_S], now);
+        channel[1]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_D], now);
+        channel[2]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_F], now);
+        channel[3]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_J], now);
+        channel[4]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_K], now);
+        channel[5]->bind_value(current_music_pos_ms, scan_res[SDL_SCANCODE_L], now);
         // update statistics
         combo_text->change_text(score_calculator->get_combo_string());
         score_text->change_text(score_calculator->get_score_string());
@@ -143,13 +163,15 @@ namespace anisette::screens
     }
 
     void StageScreen::on_focus(const uint64_t &now) {
-        utils::discord::set_playing_song(beatmap->title, beatmap->artist);
+        utils::discord::set_playing_song(beatmap.title, beatmap.artist);
         core::toggle_background_parallax(false);
         if (action_hook.empty()) action_start_time = now;
         // load music
         action_hook.emplace([this](const uint64_t &action_now) {
-            core::audio::stop_music();
-            core::audio::play_music(beatmap->music_path, beatmap->title + " - " + beatmap->artist);
+            // restarts from the beginning, the library preview usually has the same content loaded already
+            core::audio::set_music_rate(score_calculator->rate_percent);
+            music_loaded = core::audio::play_music(beatmap.music_path, beatmap.title + " - " + beatmap.artist,
+                                                   beatmap.music_id);
             paused = false;
             // temporary pause
             core::audio::pause_music();
@@ -171,8 +193,11 @@ namespace anisette::screens
         last_tick = SDL_GetTicks();
         action_hook.emplace([this](const uint64_t &action_now) {
             if (current_music_pos_ms >= 0) {
-                current_music_pos_ms = 0;
                 core::audio::resume_music();
+                // without music there is nothing to follow, the chart keeps running on the tick counter
+                music_started = music_loaded && !core::audio::music_failed();
+                // the audio clock already accounts for the output latency
+                if (music_started) current_music_pos_ms = core::audio::music_position_ms();
                 return true;
             }
             return false;
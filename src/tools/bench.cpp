@@ -0,0 +1,335 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "data.h"
+#include "logging.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define SCHEMA_URL "https://raw.githubusercontent.com/im-yuuki/AnisetteProject/refs/heads/sdl2/scripts/beatmap.schema.json"
+#define LOOKUP_COUNT 1000000
+// charts kept in memory at once to time the star rating alone
+#define RATING_SAMPLE_COUNT 500
+// only directories holding this file are ever wiped
+#define BENCH_MARKER ".anisette_bench"
+using namespace anisette;
+
+struct BenchOptions {
+    std::string work_dir = (std::filesystem::temp_directory_path() / "anisette_bench").string();
+    unsigned maps = 5000;
+    unsigned maps_per_set = 5;
+    // notes per second over all 6 channels, and the song length range in seconds
+    unsigned density = 8;
+    unsigned min_length = 60, max_length = 240;
+    // percentage of files that are broken on purpose
+    unsigned malformed = 2;
+    unsigned workers = 0;
+    unsigned seed = 1;
+    bool keep = false;
+};
+
+// one measured phase of the report
+struct Phase {
+    std::string name;
+    double ms;
+    uint64_t items;
+    uint64_t bytes;
+};
+
+static std::vector<Phase> phases;
+
+static uint64_t peak_rss_kb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/**
+ * @brief Run a phase and record its duration
+ */
+template <typename F>
+static void measure(const std::string &name, const uint64_t items, const uint64_t bytes, F &&phase) {
+    const auto start = std::chrono::steady_clock::now();
+    phase();
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    phases.push_back({name, elapsed.count(), items, bytes});
+}
+
+static std::string random_words(std::mt19937 &random, const int min_count, const int max_count) {
+    static constexpr const char *words[] = {
+        "night", "sky", "blue", "dream", "fire", "snow", "star", "light", "heart", "rain", "summer", "echo",
+        "shadow", "crystal", "river", "moon", "wind", "memory", "garden", "silver", "world", "ocean", "spark", "zero"
+    };
+    std::string result;
+    const int count = std::uniform_int_distribution(min_count, max_count)(random);
+    for (int i = 0; i < count; i++) {
+        if (i) result.push_back(' ');
+        result += words[random() % std::size(words)];
+    }
+    // some uppercase and non-ASCII text, like real libraries
+    if (random() % 4 == 0) result[0] = static_cast<char>(result[0] - 'a' + 'A');
+    if (random() % 10 == 0) result += " \xE3\x82\xB9\xE3\x82\xBF\xE3\x83\xBC";
+    return result;
+}
+
+/**
+ * @brief Write one beatmap following scripts/beatmap.schema.json, or a broken variant of it
+ *
+ * @return size of the file in bytes
+ */
+static size_t write_beatmap(const std::filesystem::path &path, const unsigned id, const BenchOptions &options,
+                            std::mt19937 &random, const bool malformed) {
+    const unsigned length_ms = std::uniform_int_distribution(options.min_length, options.max_length)(random) * 1000;
+    const int difficulty = static_cast<int>(random() % 101);
+    const int broken_kind = malformed ? static_cast<int>(random() % 5) : -1;
+    std::string json;
+    json.reserve(length_ms / 1000 * options.density * 16 + 512);
+    json += "{\"$schema\":\"";
+    json += broken_kind == 0 ? "https://example.com/unknown.json" : SCHEMA_URL;
+    json += "\",\"version\":1,\"id\":" + std::to_string(id);
+    json += ",\"title\":\"" + random_words(random, 1, 4) + "\"";
+    json += ",\"artist\":\"" + random_words(random, 1, 2) + "\"";
+    json += ",\"thumbnail\":\"bg.jpg\",\"music\":\"audio.mp3\"";
+    json += ",\"preview_point\":" + std::to_string(length_ms / 3);
+    // out of range on purpose
+    json += ",\"difficulty\":" + std::to_string(broken_kind == 1 ? 250 : difficulty);
+    if (broken_kind != 2) json += ",\"hp_drain\":" + std::to_string(random() % 101);
+
+    // notes, spread over the channels in time order
+    std::string channels[6];
+    int single_count = 0, hold_count = 0;
+    int next[6] {};
+    const unsigned total = length_ms / 1000 * options.density;
+    for (unsigned i = 0; i < total; i++) {
+        const int c = static_cast<int>(random() % 6);
+        const int start = std::max(next[c] + 50, static_cast<int>(static_cast<uint64_t>(length_ms) * i / total));
+        const bool hold = random() % 5 == 0;
+        const int end = hold ? start + 200 + static_cast<int>(random() % 800) : 0;
+        next[c] = hold ? end : start;
+        if (!channels[c].empty()) channels[c].push_back(',');
+        channels[c] += '[' + std::to_string(start) + ',';
+        // a note with a missing end on purpose
+        if (broken_kind == 3 && i == total / 2) channels[c] += "]";
+        else channels[c] += std::to_string(end) + ']';
+        (hold ? hold_count : single_count)++;
+    }
+    json += ",\"notes\":{\"single_note_count\":" + std::to_string(single_count);
+    json += ",\"hold_note_count\":" + std::to_string(hold_count);
+    for (int c = 0; c < 6; c++) json += ",\"channel_" + std::to_string(c) + "\":[" + channels[c] + ']';
+    json += "}}";
+    // truncated file, like an interrupted download
+    if (broken_kind == 4) json.resize(json.size() / 2);
+
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs.write(json.data(), static_cast<std::streamsize>(json.size()));
+    return json.size();
+}
+
+// until the beatmaps are rated, their caches compiled and the manifest saved, not only published
+static void wait_scan(const data::BeatmapLoader &loader) {
+    while (!loader.is_idle()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+static void print_report(const BenchOptions &options) {
+    std::printf("\n%-28s %10s %12s %14s %10s\n", "phase", "ms", "items", "items/s", "MB/s");
+    for (const auto &[name, ms, items, bytes] : phases) {
+        const double seconds = ms / 1000;
+        std::printf("%-28s %10.2f %12llu %14.0f", name.c_str(), ms, static_cast<unsigned long long>(items),
+                    seconds > 0 ? items / seconds : 0);
+        if (bytes > 0) std::printf(" %10.1f", seconds > 0 ? bytes / seconds / (1024 * 1024) : 0);
+        std::printf("\n");
+    }
+    std::printf("\npeak RSS: %.1f MB, workers: %u\n", peak_rss_kb() / 1024.0,
+                options.workers ? options.workers : std::thread::hardware_concurrency());
+}
+
+static void print_usage() {
+    std::cout << R"(Usage: anisette_bench [options]
+Generate a synthetic beatmap library and time the library loader.
+
+Options:
+  --dir <path>        work directory, must be empty or a previous benchmark directory (default: <temp>/anisette_bench)
+  --maps <n>          number of beatmaps (default: 5000)
+  --per-set <n>       beatmaps per set directory (default: 5)
+  --density <n>       notes per second (default: 8)
+  --length <min> <max> song length range in seconds (default: 60 240)
+  --malformed <pct>   percentage of broken files (default: 2)
+  -j <n>              scan workers (default: all hardware threads)
+  --seed <n>          generator seed (default: 1)
+  --keep              keep the work directory after the run
+)";
+}
+
+int main(const int argc, char **argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto number = [&](unsigned &value) {
+            if (i + 1 < argc) value = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        };
+        if (arg == "--dir" && i + 1 < argc) options.work_dir = argv[++i];
+        else if (arg == "--maps") number(options.maps);
+        else if (arg == "--per-set") number(options.maps_per_set);
+        else if (arg == "--density") number(options.density);
+        else if (arg == "--length") {
+            number(options.min_length);
+            number(options.max_length);
+        }
+        else if (arg == "--malformed") number(options.malformed);
+        else if (arg == "-j") number(options.workers);
+        else if (arg == "--seed") number(options.seed);
+        else if (arg == "--keep") options.keep = true;
+        else {
+            print_usage();
+            return arg == "-h" || arg == "--help" ? 0 : 2;
+        }
+    }
+    if (options.maps_per_set == 0) options.maps_per_set = 1;
+    if (options.max_length < options.min_length) options.max_length = options.min_length;
+    logging::init();
+    // debug builds log every beatmap load to stdout, which would be timed with the phases
+    logging::set_level(spdlog::level::warn);
+
+    // the loader works on paths relative to the game directory. Made absolute first, so the directory checked is the
+    // one removed at the end, after the working directory has changed
+    std::error_code ec;
+    options.work_dir = std::filesystem::absolute(options.work_dir, ec).string();
+    const auto marker = std::filesystem::path(options.work_dir) / BENCH_MARKER;
+    if (!std::filesystem::is_empty(options.work_dir, ec) && !ec && !std::filesystem::exists(marker)) {
+        std::cerr << "Refusing to wipe " << options.work_dir << ", it is not a benchmark directory" << std::endl;
+        return 1;
+    }
+    std::filesystem::remove_all(options.work_dir, ec);
+    std::filesystem::create_directories(options.work_dir, ec);
+    std::ofstream(marker).close();
+    if (ec) {
+        std::cerr << "Cannot create work directory " << options.work_dir << ": " << ec.message() << std::endl;
+        return 1;
+    }
+    std::filesystem::current_path(options.work_dir);
+
+    // generate
+    std::vector<std::pair<std::filesystem::path, std::string>> files;
+    uint64_t total_bytes = 0;
+    unsigned malformed_count = 0;
+    measure("generate", options.maps, 0, [&] {
+        std::mt19937 random(options.seed);
+        for (unsigned i = 0; i < options.maps; i++) {
+            const auto dir = std::filesystem::path("beatmaps") / ("set" + std::to_string(i / options.maps_per_set));
+            if (i % options.maps_per_set == 0) std::filesystem::create_directories(dir);
+            const auto name = std::to_string(i + 1) + ".json";
+            const bool malformed = random() % 100 < options.malformed;
+            malformed_count += malformed;
+            total_bytes += write_beatmap(dir / name, i + 1, options, random, malformed);
+            files.emplace_back(dir, name);
+        }
+    });
+    phases.back().bytes = total_bytes;
+    std::printf("library: %u maps (%u malformed) in %u sets, %.1f MB\n", options.maps, malformed_count,
+                (options.maps + options.maps_per_set - 1) / options.maps_per_set, total_bytes / (1024.0 * 1024.0));
+
+    // loaders are never destroyed, their scan threads are detached like in the game
+    const auto scan = [&](const std::string &name) {
+        const auto loader = new data::BeatmapLoader();
+        measure(name, options.maps, total_bytes, [&] {
+            loader->scan(options.workers);
+            wait_scan(*loader);
+        });
+        return loader->snapshot();
+    };
+    // cold: every header is parsed from JSON, then every map is rated and its cache compiled
+    const auto library = scan("scan (cold)");
+    // warm: every header comes from the library manifest
+    scan("scan (manifest)");
+
+    uint64_t checksum = 0;
+    // full parse including notes, single thread
+    unsigned valid = 0;
+    measure("Beatmap::load (notes)", options.maps, total_bytes, [&] {
+        data::NoteChart chart;
+        for (const auto &[dir, name] : files) {
+            data::Beatmap beatmap;
+            valid += beatmap.load(name, dir.string(), &chart);
+        }
+    });
+    std::printf("valid: %u of %u maps, %zu in the library\n", valid, options.maps, library->size());
+
+    // star rating alone, the share of the cold scan spent in it
+    std::vector<data::NoteChart> charts(std::min<size_t>(RATING_SAMPLE_COUNT, library->size()));
+    for (uint32_t i = 0; i < charts.size(); i++) library->get(i).load_notes(charts[i]);
+    measure("rate_chart", charts.size(), 0, [&] {
+        for (const auto &chart : charts) checksum += data::rate_chart(chart);
+    });
+    charts.clear();
+
+    // on demand note loading, the cold scan already compiled every cache
+    measure("load_notes (cached)", library->size(), 0, [&] {
+        data::NoteChart chart;
+        for (uint32_t i = 0; i < library->size(); i++) library->get(i).load_notes(chart);
+    });
+    // without the manifest, headers come from the compiled caches
+    std::filesystem::remove("cache/library.bin", ec);
+    scan("scan (compiled cache)");
+
+    // snapshot build: string arena, records, id index, sort permutations and search index
+    std::vector<data::Beatmap> list;
+    measure("snapshot get (all)", library->size(), 0, [&] {
+        for (uint32_t i = 0; i < library->size(); i++) list.push_back(library->get(i));
+    });
+    std::shared_ptr<data::LibrarySnapshot> snapshot;
+    measure("snapshot build", list.size(), 0, [&] {
+        snapshot = std::make_shared<data::LibrarySnapshot>(1, list);
+    });
+    list = {};
+    std::printf("snapshot: %zu records of %zu bytes, %.1f KB of strings\n", snapshot->size(),
+                sizeof(data::BeatmapRecord), snapshot->string_bytes() / 1024.0);
+    measure("sorted walk (all orders)", snapshot->size() * data::NONE * 2, 0, [&] {
+        for (int strategy = 0; strategy < data::NONE; strategy++) {
+            for (const bool ascending : {true, false}) {
+                for (size_t i = 0; i < snapshot->size(); i++) {
+                    checksum += snapshot->slot_at(static_cast<data::SortStrategy>(strategy), ascending, i);
+                }
+            }
+        }
+    });
+    measure("find by id", LOOKUP_COUNT, 0, [&] {
+        std::mt19937 random(options.seed);
+        for (int i = 0; i < LOOKUP_COUNT; i++) checksum += snapshot->find(random() % (options.maps + 1)).slot;
+    });
+    static constexpr const char *queries[] = {"n", "st", "night", "sky blue", "dream heart", "zero memory garden"};
+    measure("search", std::size(queries), 0, [&] {
+        for (const auto query : queries) checksum += snapshot->search(query, data::BY_TITLE, true).size();
+    });
+
+    print_report(options);
+    // keeps the measured loops from being optimized away
+    std::printf("checksum: %llu\n", static_cast<unsigned long long>(checksum));
+    if (!options.keep) {
+        std::filesystem::current_path(std::filesystem::temp_directory_path());
+        std::filesystem::remove_all(options.work_dir, ec);
+    }
+    return 0;
+}
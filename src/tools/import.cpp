@@ -0,0 +1,69 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#include "importer.h"
+#include "logging.h"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+using namespace anisette;
+
+static void print_usage() {
+    std::cout << R"(Usage: anisette_import [options] [archive.osz | directory]...
+Import osu!mania .osz archives into the Anisette beatmap library.
+Without inputs, every .osz file in the current directory is imported.
+
+Options:
+  -o <dir>      library directory to write into (default: beatmaps)
+  -j <count>    worker threads (default: all hardware threads)
+  --no-cache    only write the JSON beatmaps, skip the compiled cache
+  -h, --help    show this message
+)";
+}
+
+static void collect_archives(const std::filesystem::path &path, std::vector<std::string> &archives) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(path, ec)) {
+        archives.push_back(path.string());
+        return;
+    }
+    for (const auto &entry : std::filesystem::directory_iterator(path, ec)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".osz") archives.push_back(entry.path().string());
+    }
+}
+
+int main(const int argc, char **argv) {
+    logging::init();
+    importer::ImportOptions options;
+    std::vector<std::string> archives;
+    bool has_inputs = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        }
+        if (arg == "--no-cache") options.write_cache = false;
+        else if (arg == "-o" && i + 1 < argc) options.output_dir = argv[++i];
+        else if (arg == "-j" && i + 1 < argc) options.workers = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg.starts_with("-")) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage();
+            return 2;
+        } else {
+            collect_archives(arg, archives);
+            has_inputs = true;
+        }
+    }
+    // options alone still import the current directory, an input directory without archives does not
+    if (!has_inputs) collect_archives(".", archives);
+    if (archives.empty()) {
+        std::cerr << "No .osz archive found" << std::endl;
+        return 1;
+    }
+    const auto result = importer::import_archives(archives, options);
+    std::cout << "Imported " << result.beatmaps << " beatmaps from " << result.archives << " archives, "
+              << result.failed_archives << " archives failed, " << result.skipped_beatmaps << " difficulties skipped"
+              << std::endl;
+    return result.failed_archives == 0 ? 0 : 1;
+}
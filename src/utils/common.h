@@ -33,12 +33,18 @@ namespace anisette::utils
 
     class ScoreCalculator {
     public:
-        explicit ScoreCalculator(const int base_offset_ms = 50, const int hp_drain = 0) : hp_drain(hp_drain), base_offset_ms(base_offset_ms) {}
+        /**
+         * @param rate_percent Playback rate, the judgement window is in music time and scaled by the rate so it lasts
+         *                     as long in real time at any rate
+         */
+        explicit ScoreCalculator(const int base_offset_ms = 50, const int hp_drain = 0, const int rate_percent = 100)
+            : hp_drain(hp_drain), base_offset_ms(base_offset_ms * rate_percent / 100), rate_percent(rate_percent) {}
         unsigned score = 0, combo = 0, note_count = 0, success = 0;
 
         int hp = 500;
         int hp_drain = 0;
         const int base_offset_ms;
+        const int rate_percent;
 
         void submit_success() {
             note_count++;
@@ -0,0 +1,90 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace anisette::utils
+{
+    /**
+     * @brief Open-addressing hash index from 32-bit keys to 32-bit slots
+     *
+     * Entries live in one flat array with linear probing, so a lookup touches one or two cache lines.
+     * The index only grows, it is meant to be built once and then queried.
+     */
+    class FlatIndex {
+    public:
+        static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+        /**
+         * @brief Make room for count keys without rehashing
+         */
+        void reserve(const size_t count) {
+            size_t capacity = 16;
+            while (capacity < count * 2) capacity <<= 1;
+            if (capacity > entries.size()) rehash(capacity);
+        }
+
+        /**
+         * @brief Insert a key, an existing key keeps its slot
+         *
+         * @return false if the key was already present
+         */
+        bool insert(const uint32_t key, const uint32_t value) {
+            if ((count + 1) * 2 > entries.size()) rehash(entries.empty() ? 16 : entries.size() * 2);
+            for (size_t i = bucket(key);; i = (i + 1) & mask) {
+                if (entries[i].value == NOT_FOUND) {
+                    entries[i] = {key, value};
+                    count++;
+                    return true;
+                }
+                if (entries[i].key == key) return false;
+            }
+        }
+
+        uint32_t find(const uint32_t key) const {
+            if (entries.empty()) return NOT_FOUND;
+            for (size_t i = bucket(key);; i = (i + 1) & mask) {
+                if (entries[i].value == NOT_FOUND) return NOT_FOUND;
+                if (entries[i].key == key) return entries[i].value;
+            }
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        void clear() {
+            entries.clear();
+            count = 0;
+            mask = 0;
+        }
+
+    private:
+        struct Entry {
+            uint32_t key = 0;
+            uint32_t value = NOT_FOUND;
+        };
+
+        size_t bucket(const uint32_t key) const {
+            // fibonacci hashing, spreads sequential ids over the whole table
+            return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+        }
+
+        void rehash(const size_t capacity) {
+            std::vector<Entry> old(capacity);
+            old.swap(entries);
+            mask = capacity - 1;
+            count = 0;
+            for (const auto &entry : old) {
+                if (entry.value != NOT_FOUND) insert(entry.key, entry.value);
+            }
+        }
+
+        std::vector<Entry> entries;
+        size_t count = 0;
+        size_t mask = 0;
+    };
+} // namespace anisette::utils
@@ -0,0 +1,29 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace anisette::utils
+{
+    constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+    /**
+     * @brief 64-bit FNV-1a hash, can be chained by passing the previous result as seed
+     */
+    inline uint64_t fnv1a64(const void *data, const size_t size, uint64_t seed = FNV_OFFSET_BASIS) {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            seed ^= bytes[i];
+            seed *= FNV_PRIME;
+        }
+        return seed;
+    }
+
+    inline uint64_t fnv1a64(const std::string_view str, const uint64_t seed = FNV_OFFSET_BASIS) {
+        return fnv1a64(str.data(), str.size(), seed);
+    }
+} // namespace anisette::utils
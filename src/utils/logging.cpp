@@ -25,6 +25,10 @@ namespace anisette::logging
         output_sink->set_level(default_level);
     }
 
+    void set_level(const level::level_enum level) {
+        output_sink->set_level(level);
+    }
+
     std::shared_ptr<logger> get(const std::string &name) {
         const auto _return = std::make_shared<logger>(logger(name, output_sink));
         _return->set_level(default_level);
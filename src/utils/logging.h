@@ -24,6 +24,13 @@ namespace anisette::logging
      */
     extern void init();
 
+    /**
+     * @brief Drop messages below a level, for every logger
+     *
+     * @param level Minimum level written to the output
+     */
+    extern void set_level(spdlog::level::level_enum level);
+
     /**
      * @brief Get the logger instance by name
      *
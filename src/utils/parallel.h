@@ -0,0 +1,52 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace anisette::utils
+{
+    /**
+     * @brief Resolve the worker count for a parallel job
+     *
+     * @param requested Requested worker count, 0 means use all hardware threads
+     * @param job_count Number of jobs, the pool never spawns more workers than jobs
+     * @return Worker count, at least 1
+     */
+    inline unsigned resolve_worker_count(const unsigned requested, const size_t job_count) {
+        unsigned workers = requested;
+        if (workers == 0) workers = std::thread::hardware_concurrency();
+        if (workers == 0) workers = 1;
+        if (job_count < workers) workers = static_cast<unsigned>(std::max<size_t>(job_count, 1));
+        return workers;
+    }
+
+    /**
+     * @brief Run a job for every index in [0, count) on a bounded pool of workers
+     *
+     * Jobs are pulled from a shared atomic counter, so slow jobs do not stall the other workers.
+     * The calling thread takes part as one of the workers and returns when all jobs are done.
+     *
+     * @param count Number of jobs
+     * @param workers Maximum worker count, 0 means use all hardware threads
+     * @param job Job function, called with the job index
+     */
+    inline void parallel_for(const size_t count, const unsigned workers, const std::function<void(size_t)> &job) {
+        if (count == 0) return;
+        std::atomic_size_t next = 0;
+        const auto worker = [&next, count, &job]() {
+            for (size_t i = next++; i < count; i = next++) job(i);
+        };
+        const unsigned worker_count = resolve_worker_count(workers, count);
+        std::vector<std::thread> threads;
+        threads.reserve(worker_count - 1);
+        for (unsigned i = 1; i < worker_count; i++) threads.emplace_back(worker);
+        worker();
+        for (auto &t : threads) t.join();
+    }
+} // namespace anisette::utils
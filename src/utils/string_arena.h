@@ -0,0 +1,58 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include "hash.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace anisette::utils
+{
+    // a string stored in a StringArena
+    struct StringRef {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    /**
+     * @brief Append-only buffer of interned strings
+     *
+     * Equal strings are stored once and share the same reference, so references can be compared by offset.
+     * The lookup table is only needed while interning, finish() releases it.
+     */
+    class StringArena {
+    public:
+        StringRef intern(const std::string_view str) {
+            const uint64_t hash = fnv1a64(str);
+            const auto it = lookup.find(hash);
+            if (it != lookup.end() && get(it->second) == str) return it->second;
+            const StringRef ref {static_cast<uint32_t>(data.size()), static_cast<uint32_t>(str.size())};
+            data.append(str);
+            // a 64-bit collision only costs a duplicate, the first string keeps the slot
+            if (it == lookup.end()) lookup.emplace(hash, ref);
+            return ref;
+        }
+
+        [[nodiscard]] std::string_view get(const StringRef ref) const {
+            return {data.data() + ref.offset, ref.length};
+        }
+
+        /**
+         * @brief Drop the lookup table and the spare capacity, strings interned afterwards are not deduplicated
+         */
+        void finish() {
+            lookup = {};
+            data.shrink_to_fit();
+        }
+
+        [[nodiscard]] size_t size() const {
+            return data.size();
+        }
+
+    private:
+        std::string data;
+        std::unordered_map<uint64_t, StringRef> lookup;
+    };
+} // namespace anisette::utils
@@ -0,0 +1,47 @@
+//
+// Created by Yuuki on 17/10/2026.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace anisette::utils
+{
+    /**
+     * @brief Map a signed value to an unsigned one, small magnitudes of either sign stay small
+     */
+    inline uint32_t zigzag_encode(const int32_t value) {
+        return static_cast<uint32_t>(value) << 1 ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    inline int32_t zigzag_decode(const uint32_t value) {
+        return static_cast<int32_t>(value >> 1 ^ (~(value & 1) + 1));
+    }
+
+    /**
+     * @brief Append a LEB128 varint, 7 bits per byte with the high bit set on all but the last byte
+     */
+    inline void put_varint(std::string &out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    /**
+     * @brief Read a varint at cursor and advance it
+     *
+     * @return false if the varint runs past end or is longer than 5 bytes
+     */
+    inline bool get_varint(const char *&cursor, const char *end, uint32_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 35 && cursor < end; shift += 7) {
+            const auto byte = static_cast<uint8_t>(*cursor++);
+            value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+} // namespace anisette::utils